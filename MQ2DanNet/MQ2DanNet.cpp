@@ -19,12 +19,9 @@
 #include "..\MQ2DanNetDeps\libzyre\include\zyre.h"
 #endif
 
+// MQ2DANNET_HEADLESS builds just the node, with no client behind it (see test/, which runs nodes over loopback)
+#ifndef MQ2DANNET_HEADLESS
 #include <mq/Plugin.h>
-
-#ifdef LOCAL_BUILD
-#include <archive.h>
-#else
-#include "..\archive\archive.h"
 #endif
 
 #include <regex>
@@ -32,31 +29,60 @@
 #include <functional>
 #include <numeric>
 #include <sstream>
+#include <stdexcept>
+#include <string_view>
 #include <algorithm>
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <list>
 #include <map>
+#include <memory>
 #include <queue>
 #include <set>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <type_traits>
 #include <mutex>
+#include <thread>
 
+#ifndef MQ2DANNET_HEADLESS
 PLUGIN_VERSION(0.7525);
 PreSetup("MQ2DanNet");
+#else
+// the little the node still takes from MQ's headers
+#ifndef MAX_STRING
+#define MAX_STRING 2048
+#endif
+#ifndef _MSC_VER
+#define __int64 long long
+#endif
+#endif
 
 #pragma region NodeDefs
 
-#ifdef MQ2DANNET_NODE_EXPORTS
+#if !defined(_WIN32)
+#define MQ2DANNET_NODE_API
+#elif defined(MQ2DANNET_NODE_EXPORTS)
 #define MQ2DANNET_NODE_API __declspec(dllexport)
 #else
 #define MQ2DANNET_NODE_API __declspec(dllimport)
 #endif
 
 // reduce some boilerplate - we don't actually want to instantiate our commands, so delete all 5 assign/ctors
-#define COMMAND(_Name, ...)                                                         \
+// _Fields is the parenthesized list of body field types, see `fields`
+#define COMMAND_FIELDS(...) __VA_ARGS__
+#define COMMAND(_Name, _Fields, ...)                                                \
     class _Name {                                                                   \
     public:                                                                         \
+        using body = fields<COMMAND_FIELDS _Fields>;                                \
         static const std::string name() { return #_Name; }                          \
-        static const bool callback(std::stringstream&& args);                       \
-        static std::stringstream pack(const std::string& recipient, ##__VA_ARGS__); \
+        static constexpr opcode code() { return opcode::_Name; }                    \
+        static const bool callback(const message& args);                            \
+        static void pack(Node& node, frame_buffer& frame, const std::string& recipient, ##__VA_ARGS__); \
                                                                                     \
     private:                                                                        \
         _Name() = delete;                                                           \
@@ -66,30 +92,1224 @@ PreSetup("MQ2DanNet");
         _Name& operator=(_Name&&) = delete;                                         \
     };
 
-namespace MQ2DanNet {
-class Node final {
-public:
-    MQ2DANNET_NODE_API static Node& get();
+namespace MQ2DanNet {
+// wire protocol versions. v1 sends the command name as a string and Archive encodes bodies (fixed 4 byte big endian
+// lengths). v2 sends a NUL byte followed by a one byte opcode, and bodies use varint lengths. Every node advertises
+// its version in the "protocol" header, and we only ever send v2 to peers that advertised it.
+// v3 adds Updates, which carries every changed observer result for a peer in a single frame.
+// v4 adds Probe, which the receiving actor answers itself so that we can time the round trip to a peer.
+constexpr unsigned char wire_v1 = 1;
+constexpr unsigned char wire_v2 = 2;
+constexpr unsigned char wire_v3 = 3;
+constexpr unsigned char wire_v4 = 4;
+constexpr unsigned char wire_version = wire_v4;
+
+// one opcode per COMMAND, the names have to match the class names. Responses are dynamic (`response_<key>`), so the
+// key follows the Response opcode as a varint. Never reuse or reorder these, they are on the wire.
+enum class opcode : unsigned char {
+    Response = 1,
+    Echo,
+    Execute,
+    Query,
+    Observe,
+    Update,
+    Reupdate,
+    Updates,
+    Resync,
+    Probe
+};
+
+// commands the game thread sends down the actor pipe. These go as a single byte frame so that the actor can switch on
+// them, anything longer is looked up by name (zactor's $TERM, or anything still sending the old strings).
+enum class pipe_command : unsigned char {
+    Unknown = 0,
+    Term,
+    Join,
+    Leave,
+    Shout,
+    Whisper,
+    Evasive,
+    Expired,
+    Keepalive,
+    Ping,
+    Pong
+};
+
+inline pipe_command pipe_command_from(zframe_t* frame) {
+    if (!frame)
+        return pipe_command::Unknown;
+
+    const char* data = reinterpret_cast<const char*>(zframe_data(frame));
+    const size_t size = zframe_size(frame);
+    if (size == 1)
+        return static_cast<pipe_command>(data[0]);
+
+    static const std::pair<std::string_view, pipe_command> names[] = {
+        { "$TERM", pipe_command::Term },
+        { "JOIN", pipe_command::Join },
+        { "LEAVE", pipe_command::Leave },
+        { "SHOUT", pipe_command::Shout },
+        { "WHISPER", pipe_command::Whisper },
+        { "EVASIVE", pipe_command::Evasive },
+        { "EXPIRED", pipe_command::Expired },
+        { "KEEPALIVE", pipe_command::Keepalive },
+        { "PING", pipe_command::Ping },
+        { "PONG", pipe_command::Pong }
+    };
+
+    const std::string_view name(data, size);
+    for (auto& entry : names) {
+        if (entry.first == name)
+            return entry.second;
+    }
+
+    return pipe_command::Unknown;
+}
+
+inline void push_pipe_command(zmsg_t* msg, pipe_command command) {
+    const char byte = static_cast<char>(command);
+    zmsg_pushmem(msg, &byte, 1);
+}
+
+// sends command down the pipe, with args as string frames after it
+inline void send_pipe_command(zactor_t* actor, pipe_command command, std::initializer_list<std::string_view> args = {}) {
+    zmsg_t* msg = zmsg_new();
+    for (auto& arg : args) {
+        zmsg_addmem(msg, arg.data(), arg.size());
+    }
+
+    push_pipe_command(msg, command);
+    zmsg_send(&msg, actor);
+}
+
+inline size_t encode_varint(unsigned __int64 value, char* out) {
+    size_t size = 0;
+    do {
+        unsigned char byte = static_cast<unsigned char>(value & 0x7f);
+        value >>= 7;
+        if (value)
+            byte |= 0x80;
+        out[size++] = static_cast<char>(byte);
+    } while (value);
+
+    return size;
+}
+
+inline bool decode_varint(const char*& pos, const char* end, unsigned __int64& value) {
+    value = 0;
+    for (unsigned int shift = 0; pos < end && shift < 64; shift += 7) {
+        const unsigned char byte = static_cast<unsigned char>(*pos++);
+        value |= static_cast<unsigned __int64>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+inline unsigned __int64 zigzag_encode(__int64 value) {
+    return (static_cast<unsigned __int64>(value) << 1) ^ static_cast<unsigned __int64>(value >> 63);
+}
+
+inline __int64 zigzag_decode(unsigned __int64 value) {
+    return static_cast<__int64>(value >> 1) ^ -static_cast<__int64>(value & 1);
+}
+
+// how an observer result is encoded in Updates. Numbers are a decimal mantissa plus the number of places after the
+// point, so that they turn back into exactly the string ParseMacroData gave us. Deltas are against the mantissa of the
+// previous result for the same observer, and only valid if the receiver has the result with the previous sequence.
+enum class value_tag : unsigned char {
+    String,
+    Null,
+    True,
+    False,
+    Number,     // varint places, zigzag mantissa
+    NumberDelta // zigzag mantissa difference, same places as the previous result
+};
+
+// splits a decimal like "-12.50" into (2, -1250), but only if format_number() would give back the same string
+inline bool parse_number(std::string_view text, unsigned int& places, __int64& mantissa) {
+    if (text.empty() || text.size() > 18)
+        return false;
+
+    size_t pos = text[0] == '-' ? 1 : 0;
+    const size_t digits_start = pos;
+    size_t point = std::string_view::npos;
+    unsigned __int64 value = 0;
+    for (; pos < text.size(); ++pos) {
+        if (text[pos] == '.' && point == std::string_view::npos && pos > digits_start && pos + 1 < text.size()) {
+            point = pos;
+        } else if (text[pos] >= '0' && text[pos] <= '9') {
+            value = value * 10 + (text[pos] - '0');
+        } else {
+            return false;
+        }
+    }
+
+    const size_t int_digits = (point == std::string_view::npos ? text.size() : point) - digits_start;
+    if (int_digits == 0 || (int_digits > 1 && text[digits_start] == '0') || (digits_start == 1 && value == 0))
+        return false;
+
+    places = point == std::string_view::npos ? 0 : static_cast<unsigned int>(text.size() - point - 1);
+    mantissa = digits_start == 1 ? -static_cast<__int64>(value) : static_cast<__int64>(value);
+    return true;
+}
+
+inline std::string format_number(unsigned int places, __int64 mantissa) {
+    std::string digits = std::to_string(mantissa < 0 ? 0 - static_cast<unsigned __int64>(mantissa) : static_cast<unsigned __int64>(mantissa));
+    if (places > 0) {
+        if (digits.size() <= places)
+            digits.insert(0, places - digits.size() + 1, '0');
+        digits.insert(digits.size() - places, 1, '.');
+    }
+
+    return mantissa < 0 ? "-" + digits : digits;
+}
+
+// an observation result. Numbers and booleans are kept as numbers (decimals keep their places, so that they print back
+// exactly as they were sent) and anything else as a string, which stays inline in std::string's buffer if it's short.
+class observed_value final {
+public:
+    enum class kind : unsigned char { Null, Int, Decimal, Bool, String };
+
+    observed_value() : _kind(kind::Null), _places(0), _mantissa(0) {}
+
+    static observed_value parse(std::string_view text) {
+        unsigned int places = 0;
+        __int64 mantissa = 0;
+        if (text == "NULL")
+            return observed_value();
+        if (text == "TRUE" || text == "FALSE")
+            return boolean(text == "TRUE");
+        if (parse_number(text, places, mantissa))
+            return number(places, mantissa);
+        return string(std::string(text));
+    }
+
+    static observed_value number(unsigned int places, __int64 mantissa) {
+        observed_value value;
+        value._kind = places == 0 ? kind::Int : kind::Decimal;
+        value._places = static_cast<unsigned char>(places);
+        value._mantissa = mantissa;
+        return value;
+    }
+
+    static observed_value boolean(bool b) {
+        observed_value value;
+        value._kind = kind::Bool;
+        value._mantissa = b ? 1 : 0;
+        return value;
+    }
+
+    static observed_value string(std::string text) {
+        observed_value value;
+        value._kind = kind::String;
+        value._text = std::move(text);
+        return value;
+    }
+
+    kind type() const { return _kind; }
+    bool is_number() const { return _kind == kind::Int || _kind == kind::Decimal; }
+    unsigned int places() const { return _places; }
+    __int64 mantissa() const { return _mantissa; }
+
+    __int64 as_int() const { return _kind == kind::Decimal ? _mantissa / pow10(_places) : _mantissa; }
+    double as_double() const { return _kind == kind::Decimal ? static_cast<double>(_mantissa) / pow10(_places) : static_cast<double>(_mantissa); }
+    bool as_bool() const { return _mantissa != 0; }
+    const std::string& text() const { return _text; }
+
+    // writes the value out exactly as it was received
+    void to_string(char* dest, size_t size) const {
+        switch (_kind) {
+        case kind::Null:
+            snprintf(dest, size, "NULL");
+            break;
+        case kind::Bool:
+            snprintf(dest, size, "%s", _mantissa ? "TRUE" : "FALSE");
+            break;
+        case kind::Int:
+            snprintf(dest, size, "%lld", static_cast<long long>(_mantissa));
+            break;
+        case kind::Decimal: {
+            const unsigned __int64 magnitude = _mantissa < 0 ? 0 - static_cast<unsigned __int64>(_mantissa) : static_cast<unsigned __int64>(_mantissa);
+            const unsigned __int64 scale = pow10(_places);
+            snprintf(dest, size, "%s%llu.%0*llu", _mantissa < 0 ? "-" : "", magnitude / scale, static_cast<int>(_places), magnitude % scale);
+            break;
+        }
+        case kind::String:
+            snprintf(dest, size, "%s", _text.c_str());
+            break;
+        }
+    }
+
+    std::string str() const {
+        if (_kind == kind::String)
+            return _text;
+
+        char buf[32];
+        to_string(buf, sizeof(buf));
+        return buf;
+    }
+
+private:
+    kind _kind;
+    unsigned char _places;
+    __int64 _mantissa; // also the bool
+    std::string _text;
+
+    static __int64 pow10(unsigned int places) {
+        __int64 scale = 1;
+        while (places-- > 0)
+            scale *= 10;
+        return scale;
+    }
+};
+
+// the result an observer last sent, so that the next one can be checked against it. The whole result is kept, since
+// anything short of that can call two different results the same and hold back a change. assign() reuses the storage,
+// so this only allocates when a result outgrows every one before it.
+struct sent_result final {
+    bool valid = false; // false sends the next result in full (new, reupdated or resynced)
+    std::string value;
+
+    bool matches(std::string_view result) const { return valid && value == result; }
+
+    // what the next result can be delta encoded against, empty if there isn't anything
+    std::string_view previous() const { return valid ? std::string_view(value) : std::string_view(); }
+
+    void store(std::string_view result) {
+        value.assign(result.data(), result.size());
+        valid = true;
+    }
+
+    void clear() { valid = false; }
+};
+
+// outbound message body. Commands serialize straight into pooled storage, and the storage is handed to czmq as-is
+// with zframe_frommem. czmq gives it back to the pool through the frame destructor once the frame is done with, so
+// nothing is copied after pack(). Storage is only taken from the pool on the first write.
+class frame_buffer final {
+public:
+    explicit frame_buffer(unsigned char version = wire_v1) : _data(nullptr), _version(version) {}
+    ~frame_buffer() {
+        if (_data)
+            pool().release(_data);
+    }
+
+    frame_buffer(frame_buffer&& other) noexcept : _data(other._data), _version(other._version) { other._data = nullptr; }
+    frame_buffer& operator=(frame_buffer&& rhs) noexcept {
+        std::swap(_data, rhs._data);
+        std::swap(_version, rhs._version);
+        return *this;
+    }
+
+    frame_buffer(const frame_buffer&) = delete;
+    frame_buffer& operator=(const frame_buffer&) = delete;
+
+    frame_buffer& write(const char* data, std::streamsize size) {
+        if (!_data)
+            _data = pool().acquire();
+
+        _data->insert(_data->end(), data, data + size);
+        return *this;
+    }
+
+    frame_buffer& write_varint(unsigned __int64 value) {
+        char buf[10];
+        return write(buf, encode_varint(value, buf));
+    }
+
+    frame_buffer& write_byte(unsigned char value) {
+        const char byte = static_cast<char>(value);
+        return write(&byte, 1);
+    }
+
+    // length prefixed field in whichever encoding this frame is going out as
+    frame_buffer& write_field(const char* data, size_t size) {
+        if (_version >= wire_v2) {
+            write_varint(size);
+        } else {
+            const uint32_t len = static_cast<uint32_t>(size);
+            const char len_buf[4] = { static_cast<char>(len >> 24), static_cast<char>(len >> 16), static_cast<char>(len >> 8), static_cast<char>(len) };
+            write(len_buf, sizeof(len_buf));
+        }
+
+        return write(data, size);
+    }
+
+    frame_buffer& operator<<(std::string_view value) { return write_field(value.data(), value.size()); }
+
+    // the size a field would take up on the wire, without writing it
+    static size_t field_size(size_t size, unsigned char version) {
+        char buf[10];
+        return (version >= wire_v2 ? encode_varint(size, buf) : 4) + size;
+    }
+
+    void reserve(size_t size) {
+        if (!_data)
+            _data = pool().acquire();
+
+        _data->reserve(size);
+    }
+
+    const char* data() const { return _data ? _data->data() : nullptr; }
+    size_t size() const { return _data ? _data->size() : 0; }
+    unsigned char version() const { return _version; }
+
+    // gives up the storage to a new frame, this buffer is empty afterwards
+    zframe_t* to_frame() {
+        pool().sent(size());
+
+        if (size() == 0)
+            return zframe_new(nullptr, 0); // zframe_frommem can't take empty storage, and there's nothing to copy anyway
+
+        std::vector<char>* data = _data;
+        _data = nullptr;
+        return zframe_frommem(data->data(), data->size(), &frame_buffer::destroy_frame, data);
+    }
+
+    struct stats final {
+        unsigned __int64 acquired = 0;
+        unsigned __int64 reused = 0;
+        unsigned __int64 frames = 0;
+        unsigned __int64 bytes = 0;
+        size_t pooled = 0;
+    };
+
+    static stats pool_stats() { return pool().get_stats(); }
+
+private:
+    std::vector<char>* _data;
+    unsigned char _version;
+
+    // the destructor runs on whatever thread czmq releases the frame on, so the pool is locked
+    class buffer_pool final {
+    private:
+        static constexpr size_t max_pooled = 64;         // enough to cover a pulse worth of sends
+        static constexpr size_t max_capacity = 16 * 1024; // don't hang on to the occasional huge buffer
+
+        std::mutex _mutex;
+        std::vector<std::vector<char>*> _free;
+        stats _stats;
+
+    public:
+        ~buffer_pool() {
+            for (auto data : _free)
+                delete data;
+        }
+
+        std::vector<char>* acquire() {
+            std::scoped_lock<std::mutex> lock(_mutex);
+            ++_stats.acquired;
+            if (_free.empty())
+                return new std::vector<char>();
+
+            ++_stats.reused;
+            std::vector<char>* data = _free.back();
+            _free.pop_back();
+            return data;
+        }
+
+        void release(std::vector<char>* data) {
+            std::scoped_lock<std::mutex> lock(_mutex);
+            if (_free.size() < max_pooled && data->capacity() <= max_capacity) {
+                data->clear();
+                _free.push_back(data);
+            } else {
+                delete data;
+            }
+        }
+
+        void sent(size_t bytes) {
+            std::scoped_lock<std::mutex> lock(_mutex);
+            ++_stats.frames;
+            _stats.bytes += bytes;
+        }
+
+        stats get_stats() {
+            std::scoped_lock<std::mutex> lock(_mutex);
+            stats r = _stats;
+            r.pooled = _free.size();
+            return r;
+        }
+    };
+
+    static buffer_pool& pool() {
+        static buffer_pool instance;
+        return instance;
+    }
+
+    static void destroy_frame(void** hint) {
+        if (hint && *hint) {
+            pool().release(reinterpret_cast<std::vector<char>*>(*hint));
+            *hint = nullptr;
+        }
+    }
+};
+
+// reads length prefixed fields in place. The views point into the message that the reader came from, so they are only
+// good for as long as that message is alive. Throws runtime_error on malformed data.
+class frame_reader final {
+public:
+    frame_reader(const char* data, size_t size, unsigned char version) : _pos(data), _end(data + size), _version(version) {}
+
+    frame_reader& operator>>(std::string_view& value) {
+        if (!read_field(value))
+            throw std::runtime_error("malformed data");
+        return *this;
+    }
+
+    frame_reader& operator>>(std::string& value) {
+        std::string_view view;
+        *this >> view;
+        value.assign(view.data(), view.size());
+        return *this;
+    }
+
+    frame_reader& read_varint(unsigned __int64& value) {
+        if (!decode_varint(_pos, _end, value))
+            throw std::runtime_error("malformed data");
+        return *this;
+    }
+
+    frame_reader& read_byte(unsigned char& value) {
+        if (_pos >= _end)
+            throw std::runtime_error("malformed data");
+        value = static_cast<unsigned char>(*_pos++);
+        return *this;
+    }
+
+    bool empty() const { return _pos >= _end; }
+
+private:
+    const char* _pos;
+    const char* _end;
+    unsigned char _version;
+
+    bool read_field(std::string_view& value) {
+        unsigned __int64 size = 0;
+        if (_version >= wire_v2) {
+            if (!decode_varint(_pos, _end, size))
+                return false;
+        } else {
+            if (_end - _pos < 4)
+                return false;
+            const unsigned char* len = reinterpret_cast<const unsigned char*>(_pos);
+            size = (static_cast<uint32_t>(len[0]) << 24) | (static_cast<uint32_t>(len[1]) << 16) | (static_cast<uint32_t>(len[2]) << 8) | len[3];
+            _pos += 4;
+        }
+
+        if (size > static_cast<unsigned __int64>(_end - _pos))
+            return false;
+
+        value = std::string_view(_pos, static_cast<size_t>(size));
+        _pos += size;
+        return true;
+    }
+};
+
+// how a single field goes on the wire. Strings are length prefixed fields in the frame's encoding, integers are varints
+// (zigzag if signed, so they need wire_v2 or better) and bools are a byte.
+template <typename T, typename = void>
+struct field_codec;
+
+template <>
+struct field_codec<std::string_view> {
+    static constexpr size_t max_size = 0; // unbounded
+    static size_t size(std::string_view value, unsigned char version) { return frame_buffer::field_size(value.size(), version); }
+    static void write(frame_buffer& frame, std::string_view value) { frame << value; }
+    static void read(frame_reader& reader, std::string_view& value) { reader >> value; }
+};
+
+template <>
+struct field_codec<std::string> {
+    static constexpr size_t max_size = 0; // unbounded
+    static size_t size(const std::string& value, unsigned char version) { return frame_buffer::field_size(value.size(), version); }
+    static void write(frame_buffer& frame, const std::string& value) { frame << value; }
+    static void read(frame_reader& reader, std::string& value) { reader >> value; }
+};
+
+template <>
+struct field_codec<bool> {
+    static constexpr size_t max_size = 1;
+    static size_t size(bool, unsigned char) { return 1; }
+    static size_t write(char* out, bool value) {
+        *out = value ? 1 : 0;
+        return 1;
+    }
+    static void write(frame_buffer& frame, bool value) { frame.write_byte(value ? 1 : 0); }
+    static void read(frame_reader& reader, bool& value) {
+        unsigned char byte = 0;
+        reader.read_byte(byte);
+        value = byte != 0;
+    }
+};
+
+template <typename T>
+struct field_codec<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+    static constexpr size_t max_size = 10;
+    static unsigned __int64 encode(T value) {
+        if constexpr (std::is_signed_v<T>)
+            return zigzag_encode(value);
+        else
+            return value;
+    }
+    static size_t size(T value, unsigned char) {
+        char buf[max_size];
+        return encode_varint(encode(value), buf);
+    }
+    static size_t write(char* out, T value) { return encode_varint(encode(value), out); }
+    static void write(frame_buffer& frame, T value) { frame.write_varint(encode(value)); }
+    static void read(frame_reader& reader, T& value) {
+        unsigned __int64 raw = 0;
+        reader.read_varint(raw);
+        if constexpr (std::is_signed_v<T>)
+            value = static_cast<T>(zigzag_decode(raw));
+        else
+            value = static_cast<T>(raw);
+    }
+};
+
+// the body of a command as a list of field types. encode() and decode() are both generated from the same list, so a
+// command can't write something its callback doesn't read back. If every field has a fixed upper bound the body is put
+// together on the stack and written in one go, otherwise the frame is sized once up front.
+template <typename... Fields>
+struct fields final {
+    using values = std::tuple<Fields...>;
+
+    static constexpr bool bounded = ((field_codec<Fields>::max_size > 0) && ...);
+    static constexpr size_t max_size = (field_codec<Fields>::max_size + ... + 0);
+
+    static void encode(frame_buffer& frame, const Fields&... args) {
+        if constexpr (sizeof...(Fields) == 0) {
+            return;
+        } else if constexpr (bounded) {
+            char buf[max_size];
+            size_t size = 0;
+            ((size += field_codec<Fields>::write(buf + size, args)), ...);
+            frame.write(buf, size);
+        } else {
+            frame.reserve(frame.size() + (field_codec<Fields>::size(args, frame.version()) + ...));
+            (field_codec<Fields>::write(frame, args), ...);
+        }
+    }
+
+    // throws runtime_error if the frame doesn't hold all of the fields. string_views point into the frame.
+    static values decode(frame_reader& reader) {
+        values result;
+        std::apply([&reader](Fields&... fields) -> void {
+            (field_codec<Fields>::read(reader, fields), ...);
+        }, result);
+        return result;
+    }
+};
+
+// process-wide intern pool for peer, group, query and command names. A name gets a dense id for as long as anything
+// holds a name_ref to it, so that the node can key its maps on a uint32 and only deal in strings at the edges. Once the
+// last ref goes the name is dropped and its id handed out again, so the table only ever holds names that are in use.
+// 0 is never handed out and stands for no name.
+using name_id = uint32_t;
+
+class name_ref;
+
+class name_table final {
+public:
+    // never destroyed, refs held by other statics (the node, the command ids) can outlive anything torn down at exit
+    static name_table& get() {
+        static name_table* instance = new name_table();
+        return *instance;
+    }
+
+    // the name's ref, interning it if it isn't here yet
+    name_ref intern(std::string_view name);
+
+    // doesn't add anything, for lookups of names that may never have been interned (an empty ref on a miss)
+    name_ref find(std::string_view name);
+
+    size_t size() {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        return _ids.size();
+    }
+
+    unsigned __int64 dropped() {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        return _dropped;
+    }
+
+private:
+    friend class name_ref;
+
+    struct entry final {
+        name_id id = 0;
+        std::string name;
+        std::atomic<size_t> refs{ 0 };
+    };
+
+    // the last ref can go on any thread, and the name can be interned again before the lock is taken, so this only
+    // drops it if nothing took a ref in between (and nobody dropped it already)
+    void release(entry* e) {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        if (e->refs.load(std::memory_order_acquire) != 0)
+            return;
+
+        auto it = _ids.find(e->name);
+        if (it == _ids.end() || it->second != e)
+            return;
+
+        _ids.erase(it);
+        e->name.clear();
+        _free.push_back(e);
+        ++_dropped;
+    }
+
+    std::mutex _mutex;
+    std::deque<entry> _entries;                         // id - 1, deque never moves its elements so refs can point in
+    std::vector<entry*> _free;                          // dropped, to be handed out again
+    std::unordered_map<std::string_view, entry*> _ids;  // name (viewing into its entry), entry
+    unsigned __int64 _dropped = 0;
+};
+
+// a counted reference to an interned name. Compares by id, and the name it stands for stays put for as long as it's held.
+class name_ref final {
+public:
+    name_ref() = default;
+    ~name_ref() { reset(); }
+
+    name_ref(const name_ref& other) : _entry(other._entry) {
+        if (_entry)
+            _entry->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    name_ref(name_ref&& other) noexcept : _entry(other._entry) { other._entry = nullptr; }
+
+    name_ref& operator=(name_ref rhs) noexcept {
+        std::swap(_entry, rhs._entry);
+        return *this;
+    }
+
+    name_id id() const { return _entry ? _entry->id : 0; }
+
+    const std::string& str() const {
+        static const std::string none;
+        return _entry ? _entry->name : none;
+    }
+
+    explicit operator bool() const { return _entry != nullptr; }
+
+    void reset() {
+        if (_entry && _entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            name_table::get().release(_entry);
+        _entry = nullptr;
+    }
+
+    friend bool operator==(const name_ref& lhs, const name_ref& rhs) { return lhs._entry == rhs._entry; }
+    friend bool operator!=(const name_ref& lhs, const name_ref& rhs) { return lhs._entry != rhs._entry; }
+    friend bool operator<(const name_ref& lhs, const name_ref& rhs) { return lhs.id() < rhs.id(); }
+
+private:
+    friend class name_table;
+
+    // takes over a ref the table already counted
+    explicit name_ref(name_table::entry* e) : _entry(e) {}
+
+    name_table::entry* _entry = nullptr;
+};
+
+inline name_ref name_table::intern(std::string_view name) {
+    std::scoped_lock<std::mutex> lock(_mutex);
+    auto it = _ids.find(name);
+    if (it != _ids.end()) {
+        it->second->refs.fetch_add(1, std::memory_order_relaxed);
+        return name_ref(it->second);
+    }
+
+    entry* e = nullptr;
+    if (!_free.empty()) {
+        e = _free.back();
+        _free.pop_back();
+    } else {
+        e = &_entries.emplace_back();
+        e->id = static_cast<name_id>(_entries.size());
+    }
+
+    e->name.assign(name.data(), name.size());
+    e->refs.store(1, std::memory_order_relaxed);
+    _ids.emplace(e->name, e);
+    return name_ref(e);
+}
+
+inline name_ref name_table::find(std::string_view name) {
+    std::scoped_lock<std::mutex> lock(_mutex);
+    auto it = _ids.find(name);
+    if (it == _ids.end())
+        return name_ref();
+
+    it->second->refs.fetch_add(1, std::memory_order_relaxed);
+    return name_ref(it->second);
+}
+
+// everything a node needs from the game client. The plugin runs its node on mq_host, anything that wants to run nodes
+// outside of the client (a load test, say) can hand Node its own implementation instead.
+class host {
+public:
+    virtual ~host() = default;
+
+    virtual std::string evaluate(const std::string& expression) = 0; // ParseMacroData
+    virtual void execute(const std::string& command) = 0;            // EzCommand
+    virtual void write_chat(const std::string& text) = 0;            // WriteChatf
+    virtual std::string server_name() = 0;                           // GetServerShortName
+    virtual unsigned __int64 tick() = 0;                             // MQGetTickCount64
+    virtual void debug(const std::string& text) = 0;                 // DebugSpewAlways
+    virtual std::string setting(const std::string& section, const std::string& key) = 0; // the plugin's ini
+    virtual std::string character_name() = 0;                        // GetCharInfo, empty when there's no character
+    virtual bool on_main_thread() = 0;                               // IsMainThread
+    virtual void post(std::function<void()> f) = 0;                  // PostToMainThread
+    virtual bool in_macro() = 0;                                     // gMacroBlock
+    virtual bool has_variable(const std::string& name) = 0;          // FindMQ2DataVariable
+    // FromString into the variable, then type and value are its type's name and ToString. False if there's no such variable
+    virtual bool store(const std::string& variable, const std::string& data, std::string& type, std::string& value) = 0;
+    virtual void macro_error(const std::string& text) = 0;           // MacroError
+};
+
+// bounded FIFO for exactly one producer thread and one consumer thread, no locks. Pushing into a full ring drops
+// the value and counts it. Only the consumer may call pop, remove_if and size.
+template <typename T, size_t N>
+class spsc_ring {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_ring size must be a power of 2");
+
+private:
+    struct slot final {
+        T value;
+        bool removed = false; // tombstoned by remove_if, skipped by pop
+    };
+
+    std::unique_ptr<slot[]> _slots = std::make_unique<slot[]>(N);
+    alignas(64) std::atomic<size_t> _head{ 0 }; // next to read, only the consumer writes this
+    alignas(64) std::atomic<size_t> _tail{ 0 }; // next to write, only the producer writes this
+    std::atomic<unsigned __int64> _overflows{ 0 };
+    std::atomic<size_t> _high_water{ 0 };
+
+public:
+    bool push(T&& value) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t depth = tail - _head.load(std::memory_order_acquire);
+        if (depth >= N) {
+            _overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        slot& s = _slots[tail & (N - 1)];
+        s.value = std::move(value);
+        s.removed = false;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        if (depth + 1 > _high_water.load(std::memory_order_relaxed))
+            _high_water.store(depth + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(T& value) {
+        T* next = peek();
+        if (!next)
+            return false;
+
+        value = std::move(*next);
+        *next = T(); // don't hold on to anything until the slot comes around again
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    // the oldest value that hasn't been removed, or nullptr if there isn't one
+    T* peek() {
+        size_t head = _head.load(std::memory_order_relaxed);
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            slot& s = _slots[head & (N - 1)];
+            if (!s.removed)
+                break;
+
+            s.value = T();
+        }
+
+        _head.store(head, std::memory_order_release);
+        return head != tail ? &_slots[head & (N - 1)].value : nullptr;
+    }
+
+    // the slots between head and tail belong to the consumer, so these are tombstoned in place
+    void remove_if(const std::function<bool(T&)>& f) {
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        for (size_t head = _head.load(std::memory_order_relaxed); head != tail; ++head) {
+            slot& s = _slots[head & (N - 1)];
+            if (!s.removed && f(s.value))
+                s.removed = true;
+        }
+    }
+
+    size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return N; }
+    unsigned __int64 overflows() const { return _overflows.load(std::memory_order_relaxed); }
+    size_t high_water() const { return _high_water.load(std::memory_order_relaxed); }
+};
+
+class Node;
+
+// inbound command. Owns the received body frame (or, for local delivery, the buffer it was packed into) so that the
+// handler can read the fields straight out of it
+class message final {
+public:
+    message() : _node(nullptr), _body(nullptr), _version(wire_v1) {}
+
+    // takes ownership of body
+    message(Node& node, const std::string& from, const std::string& group, zframe_t* body, unsigned char version) : _node(&node), _from(from), _group(group), _body(body), _version(version) {}
+
+    message(Node& node, const std::string& from, const std::string& group, frame_buffer&& body) : _node(&node), _from(from), _group(group), _body(nullptr), _local(std::move(body)), _version(_local.version()) {}
+
+    ~message() {
+        if (_body)
+            zframe_destroy(&_body);
+    }
+
+    message(message&& other) noexcept : _node(other._node), _from(std::move(other._from)), _group(std::move(other._group)), _body(other._body), _local(std::move(other._local)), _version(other._version), _decoded(std::move(other._decoded)) {
+        other._body = nullptr;
+    }
+
+    message& operator=(message&& rhs) noexcept {
+        std::swap(_node, rhs._node);
+        std::swap(_from, rhs._from);
+        std::swap(_group, rhs._group);
+        std::swap(_body, rhs._body);
+        std::swap(_local, rhs._local);
+        std::swap(_version, rhs._version);
+        std::swap(_decoded, rhs._decoded);
+        return *this;
+    }
+
+    message(const message&) = delete;
+    message& operator=(const message&) = delete;
+
+    // the node this was received by (or delivered to locally)
+    Node& node() const { return *_node; }
+    const std::string& from() const { return _from; }
+    const std::string& group() const { return _group; }
+
+    frame_reader reader() const {
+        if (_body)
+            return frame_reader(reinterpret_cast<const char*>(zframe_data(_body)), zframe_size(_body), _version);
+        return frame_reader(_local.data(), _local.size(), _version);
+    }
+
+    // the body as the command's decoder left it (see Node::register_decoder), nullptr if it wasn't decoded ahead of time
+    template <typename T>
+    const T* decoded() const { return std::any_cast<T>(&_decoded); }
+
+    // once decoded nothing needs the raw body any more, so let go of it right away
+    template <typename T>
+    void decoded(T&& value) {
+        _decoded = std::forward<T>(value);
+        if (_body)
+            zframe_destroy(&_body);
+    }
+
+private:
+    Node* _node;
+    std::string _from;
+    std::string _group;
+    zframe_t* _body;
+    frame_buffer _local;
+    unsigned char _version;
+    std::any _decoded;
+};
+
+class Node final {
+public:
+    // the plugin's node, running on mq_host
+    MQ2DANNET_NODE_API static Node& get();
+
+    // any number of nodes can run side by side, each one talks to the client only through its host
+    explicit Node(host& client);
+    ~Node();
+
+    host& client() { return _host; }
+
+    // WriteChatf through the host
+    template <typename... Args>
+    void chatf(const char* format, Args... args) {
+        char buf[MAX_STRING] = { 0 };
+        snprintf(buf, MAX_STRING, format, args...);
+        _host.write_chat(buf);
+    }
+
+    // DebugSpewAlways through the host
+    template <typename... Args>
+    void debugf(const char* format, Args... args) {
+        char buf[MAX_STRING] = { 0 };
+        snprintf(buf, MAX_STRING, format, args...);
+        _host.debug(buf);
+    }
+
+    MQ2DANNET_NODE_API void join(const std::string& group);
+    MQ2DANNET_NODE_API void leave(const std::string& group);
+
+    MQ2DANNET_NODE_API void on_join(std::function<bool(const std::string&, const std::string&)> callback);
+    MQ2DANNET_NODE_API void on_leave(std::function<bool(const std::string&, const std::string&)> callback);
+
+    template <typename T, typename... Args>
+    void whisper(const std::string& recipient, Args&&... args) {
+        frame_buffer arg_frame = pack<T>(peer_wire_version(recipient), recipient, std::forward<Args>(args)...);
+        respond(recipient, name<T>(), std::move(arg_frame));
+    }
+
+    template <typename T, typename... Args>
+    void shout(const std::string& group, Args&&... args) {
+        frame_buffer arg_frame = pack<T>(group_wire_version(group), group, std::forward<Args>(args)...);
+        publish(group, name<T>(), std::move(arg_frame));
+    }
+
+    // a set of names as the strings themselves, sorted the way the TLO indexes them. Worked out the first time something
+    // asks, and a copy starts over since it belongs to a new snapshot
+    class sorted_names final {
+    public:
+        sorted_names() = default;
+        sorted_names(const sorted_names&) {}
+        sorted_names& operator=(const sorted_names&) { return *this; }
+
+        const std::set<std::string>& get(const std::set<name_ref>& ids) const {
+            std::call_once(_once, [this, &ids]() -> void {
+                for (auto& id : ids) {
+                    _names.emplace_hint(_names.end(), id.str());
+                }
+            });
+
+            return _names;
+        }
+
+    private:
+        mutable std::once_flag _once;
+        mutable std::set<std::string> _names;
+    };
+
+    // one piece of a membership snapshot, shared with the snapshot it was copied from until something changes it. Only
+    // the actor writes, and only to the snapshot it hasn't published yet: a copy never owns what it points at, so the
+    // first edit() copies just this piece and the ones after it change that copy in place
+    template <typename T>
+    class shared_value final {
+    public:
+        shared_value() : _value(std::make_shared<T>()), _owned(true) {}
+        shared_value(const shared_value& other) : _value(other._value), _owned(false) {}
+        shared_value& operator=(const shared_value& other) {
+            _value = other._value;
+            _owned = false;
+            return *this;
+        }
+
+        const T& operator*() const { return *_value; }
+        const T* operator->() const { return _value.get(); }
+
+        T& edit() {
+            if (!_owned) {
+                _value = std::make_shared<T>(*_value);
+                _owned = true;
+            }
+
+            return *_value;
+        }
+
+    private:
+        std::shared_ptr<T> _value;
+        bool _owned;
+    };
+
+    using name_set = std::set<name_ref>;
+    using name_index = std::map<name_ref, shared_value<name_set>>;
+
+    // who is connected and who is in which group, published by the actor as a whole and never modified afterwards, so
+    // the game thread can hold on to one for as long as it needs without locking or copying anything. Everything is
+    // keyed on interned names, the snapshot holds a ref to each of them so they stay put for as long as it's around.
+    // Each map, and each set in the indexes, is shared with the last snapshot unless this one changed it, so an event
+    // copies the maps it touches (as pointers) and the sets it touches, and leaves everything else where it was.
+    struct membership final {
+        shared_value<std::map<name_ref, std::string>> peers;     // peer, peer_uuid
+        shared_value<std::map<name_ref, std::string>> addresses; // peer, tcp endpoint (as of ENTER)
+        shared_value<std::map<name_ref, unsigned char>> protocols; // peer, wire version (only for peers newer than v1)
+        shared_value<name_index> group_peers;                    // group, peers
+        shared_value<name_index> peer_groups;                    // peer, groups (the other side of group_peers)
+        shared_value<name_set> own_groups;                       // group
+
+        // kept in step by the functions below, so nothing here ever has to be rebuilt from scratch
+        name_ref self;                    // our own name as of the last publish
+        shared_value<name_set> names;     // peers, including ourselves
+        shared_value<name_index> members; // group, peers (including ourselves if we joined)
+        shared_value<name_set> groups;    // group, joined or not
+        unsigned __int64 generation = 0;
+
+        // for lookups by name at the API and TLO edge. Anything that isn't interned can't be in here either
+        static name_ref id(std::string_view name) { return name_table::get().find(name); }
+
+        const name_set& group_members(const name_ref& group) const { return find(*members, group); }
+        const name_set& group_members(std::string_view group) const { return group_members(id(group)); }
+        const name_set& groups_of(const name_ref& peer) const { return find(*peer_groups, peer); }
+        const name_set& groups_of(std::string_view peer) const { return groups_of(id(peer)); }
+
+        bool has_peer(std::string_view peer) const { return peers->find(id(peer)) != peers->end(); }
+        bool is_member(std::string_view group, std::string_view peer) const {
+            const name_set& in_group = group_members(group);
+            return in_group.find(id(peer)) != in_group.end();
+        }
+
+        const std::set<std::string>& peer_names() const { return _peer_names.get(*names); }
+        const std::set<std::string>& group_names() const { return _group_names.get(*groups); }
+        const std::set<std::string>& own_group_names() const { return _own_group_names.get(*own_groups); }
+
+        static std::set<std::string> strings(const name_set& ids) {
+            std::set<std::string> r;
+            for (auto& id : ids) {
+                r.emplace(id.str());
+            }
+
+            return r;
+        }
+
+        void add_peer(const name_ref& peer, const std::string& uuid) {
+            auto it = peers->find(peer);
+            if (it == peers->end() || it->second != uuid)
+                peers.edit()[peer] = uuid;
+            add(names, peer);
+        }
+
+        // only touches the groups the peer was actually in
+        void remove_peer(const name_ref& peer) {
+            erase(peers, peer);
+            erase(addresses, peer);
+            erase(protocols, peer);
+
+            auto it = peer_groups->find(peer);
+            if (it != peer_groups->end()) {
+                for (auto& group : *it->second) {
+                    remove_from(group_peers, group, peer);
+                    remove_member(group, peer);
+                }
+
+                peer_groups.edit().erase(peer);
+            }
+
+            if (peer != self)
+                erase(names, peer);
+        }
+
+        void join(const name_ref& group, const name_ref& peer) {
+            add_to(group_peers, group, peer);
+            add_to(peer_groups, peer, group);
+            add_to(members, group, peer);
+            add(groups, group);
+        }
+
+        void leave(const name_ref& group, const name_ref& peer) {
+            remove_from(group_peers, group, peer);
+            remove_from(peer_groups, peer, group);
+            remove_member(group, peer);
+        }
+
+        void join_own(const name_ref& group) {
+            add(own_groups, group);
+            add_to(members, group, self);
+            add(groups, group);
+        }
+
+        void leave_own(const name_ref& group) {
+            erase(own_groups, group);
+            remove_member(group, self);
+        }
+
+        void clear_own() {
+            if (own_groups->empty())
+                return;
+
+            const shared_value<name_set> left = own_groups;
+            own_groups = shared_value<name_set>();
+            for (auto& group : *left) {
+                remove_member(group, self);
+            }
+        }
+
+        // keep our own entries in step if the node was renamed since the last publish
+        void rename_self(const std::string& name) {
+            if (name == self.str())
+                return;
+
+            const shared_value<name_set> own = own_groups;
+            clear_own();
+            if (peers->find(self) == peers->end())
+                erase(names, self);
+
+            self = name_table::get().intern(name);
+            add(names, self);
+            for (auto& group : *own) {
+                join_own(group);
+            }
+        }
+
+    private:
+        sorted_names _peer_names;
+        sorted_names _group_names;
+        sorted_names _own_group_names;
+
+        static const name_set& find(const name_index& index, const name_ref& key) {
+            static const name_set none;
+            auto it = index.find(key);
+            return it != index.end() ? *it->second : none;
+        }
+
+        // these all look before they edit, so an event that changes nothing copies nothing
+        static void add(shared_value<name_set>& set, const name_ref& value) {
+            if (set->find(value) == set->end())
+                set.edit().emplace(value);
+        }
+
+        template <typename T>
+        static void erase(shared_value<T>& container, const name_ref& key) {
+            if (container->find(key) != container->end())
+                container.edit().erase(key);
+        }
+
+        static void add_to(shared_value<name_index>& index, const name_ref& key, const name_ref& value) {
+            auto it = index->find(key);
+            if (it == index->end() || it->second->find(value) == it->second->end())
+                index.edit()[key].edit().emplace(value);
+        }
+
+        static void remove_from(shared_value<name_index>& index, const name_ref& key, const name_ref& value) {
+            auto it = index->find(key);
+            if (it == index->end() || it->second->find(value) == it->second->end())
+                return;
+
+            if (it->second->size() == 1)
+                index.edit().erase(key);
+            else
+                index.edit()[key].edit().erase(value);
+        }
+
+        // a member is either a peer in group_peers or ourselves with the group in own_groups
+        void remove_member(const name_ref& group, const name_ref& peer) {
+            if (peer == self && own_groups->find(group) != own_groups->end())
+                return;
 
-    MQ2DANNET_NODE_API void join(const std::string& group);
-    MQ2DANNET_NODE_API void leave(const std::string& group);
+            if (find(*group_peers, group).count(peer))
+                return;
 
-    MQ2DANNET_NODE_API void on_join(std::function<bool(const std::string&, const std::string&)> callback);
-    MQ2DANNET_NODE_API void on_leave(std::function<bool(const std::string&, const std::string&)> callback);
+            auto it = members->find(group);
+            if (it == members->end() || it->second->find(peer) == it->second->end())
+                return;
 
-    template <typename T, typename... Args>
-    void whisper(const std::string& recipient, Args&&... args) {
-        std::stringstream arg_stream = pack<T>(recipient, std::forward<Args>(args)...);
-        respond(recipient, name<T>(), std::move(arg_stream));
-    }
+            remove_from(members, group, peer);
+            if (members->find(group) == members->end())
+                erase(groups, group);
+        }
+    };
 
-    template <typename T, typename... Args>
-    void shout(const std::string& group, Args&&... args) {
-        std::stringstream arg_stream = pack<T>(group, std::forward<Args>(args)...);
-        publish(group, name<T>(), std::move(arg_stream));
-    }
+    std::shared_ptr<const membership> snapshot() const { return std::atomic_load(&_membership); }
 
     MQ2DANNET_NODE_API const std::list<std::string> get_info();
+    MQ2DANNET_NODE_API const std::list<std::string> get_stats();
     MQ2DANNET_NODE_API const std::set<std::string> get_peers();
     MQ2DANNET_NODE_API const std::set<std::string> get_all_groups();
     MQ2DANNET_NODE_API const std::set<std::string> get_own_groups();
@@ -103,104 +1323,152 @@ public:
 
     // quick helper function to safely init strings from chars
     MQ2DANNET_NODE_API static std::string init_string(const char* szStr);
+    // all digits, and at least one of them (the timeouts and the protocol header)
+    static bool is_number(const char* szStr);
 
     template <typename T>
     static std::string name() { return T::name(); }
 
     template <typename T>
-    static std::function<bool(std::stringstream&&)> callback() {
+    static const name_ref& id() {
+        static const name_ref command_id = name_table::get().intern(T::name());
+        return command_id;
+    }
+
+    template <typename T>
+    static std::function<bool(const message&)> callback() {
         return T::callback;
     }
 
-    // we gotta trust that copy elision works here, which it should in c++14 or more for stringstream.
-    // worst case is a slightly slower command because we have to copy the stream
+    // frame_buffer is move-only, so this is at worst a pointer swap
     template <typename T, typename... Args>
-    static std::stringstream pack(Args&&... args) { return T::pack(std::forward<Args>(args)...); }
+    frame_buffer pack(unsigned char version, Args&&... args) {
+        frame_buffer frame(version);
+        T::pack(*this, frame, std::forward<Args>(args)...);
+        return frame;
+    }
 
     template <typename T>
-    void register_command() { register_command(name<T>(), callback<T>()); }
+    void register_command() {
+        _command_opcodes.upsert(name<T>(), T::code());
+        _opcode_commands.upsert(T::code(), id<T>());
+        register_command(name<T>(), callback<T>());
+    }
 
     template <typename T>
     void unregister_command() { unregister_command(name<T>()); }
 
+    // decoders run on the actor thread as messages come in, so that the callback on the game thread only has to do the
+    // part that touches MQ. A decoder stores what it read with message::decoded, and throws on malformed data.
+    void register_decoder(const std::string& name, std::function<void(message&)> decoder) { _command_decoders.upsert(name_table::get().intern(name), decoder); }
+    void unregister_decoder(const std::string& name) { _command_decoders.erase(name_table::get().find(name)); }
+
+    template <typename T>
+    void register_decoder(std::function<void(message&)> decoder) { register_decoder(name<T>(), decoder); }
+
+    template <typename T>
+    void unregister_decoder() { unregister_decoder(name<T>()); }
+
+    // the wire version to use when sending to peer (v1 unless they told us otherwise)
+    MQ2DANNET_NODE_API unsigned char peer_wire_version(const std::string& peer);
+    // the lowest wire version in the group, so that every peer in it can read a shout
+    MQ2DANNET_NODE_API unsigned char group_wire_version(const std::string& group);
+
     // register custom commands (for responses)
-    void register_command(const std::string& name, std::function<bool(std::stringstream&&)> callback) { _command_map.upsert(name, callback); }
-    void unregister_command(const std::string& name) { _command_map.erase(name); }
+    void register_command(const std::string& name, std::function<bool(const message&)> callback) { _command_map.upsert(name_table::get().intern(name), callback); }
+    void unregister_command(const std::string& name) { _command_map.erase(name_table::get().find(name)); }
 
     // finds and inserts the next int key, returns `"response" + new_key`
     // this is generated by the requester
-    MQ2DANNET_NODE_API std::string register_response(std::function<bool(std::stringstream&&)> callback);
-    MQ2DANNET_NODE_API void respond(const std::string& name, const std::string& cmd, std::stringstream&& args);
+    MQ2DANNET_NODE_API std::string register_response(std::function<bool(const message&)> callback);
+    MQ2DANNET_NODE_API void respond(const std::string& name, const std::string& cmd, frame_buffer&& args);
 
     struct Observation final {
         std::string output;
-        std::string data;
+        observed_value data;
         unsigned __int64 received;
 
         Observation(const Observation& obs) : output(obs.output), data(obs.data), received(obs.received) {}
-        Observation(const std::string& output) : output(output), data("NULL"), received(0) {}
-        Observation(const std::string& output, const std::string& data, unsigned __int64 received) : output(output), data(data), received(received) {}
-        Observation() : output(), data("NULL"), received(0) {}
+        Observation& operator=(const Observation&) = default;
+        Observation(const std::string& output) : output(output), data(), received(0) {}
+        Observation(const std::string& output, const std::string& data, unsigned __int64 received) : output(output), data(observed_value::parse(data)), received(received) {}
+        Observation(const std::string& output, observed_value data, unsigned __int64 received) : output(output), data(std::move(data)), received(received) {}
+        Observation() : output(), data(), received(0) {}
     };
 
     // finds query and returns the observation group, generates new group name if query not found
-    MQ2DANNET_NODE_API std::string register_observer(const std::string& group, const std::string& query);
+    // the fastest rate and heartbeat anyone asked for win, since every peer observing a query shares its group
+    MQ2DANNET_NODE_API std::string register_observer(const std::string& group, const std::string& query, unsigned int rate = 0, unsigned int heartbeat = 0);
     MQ2DANNET_NODE_API void unregister_observer(const std::string& query);
     MQ2DANNET_NODE_API void observe(const std::string& group, const std::string& name, const std::string& query);
     MQ2DANNET_NODE_API void forget(const std::string& group);
     MQ2DANNET_NODE_API void forget(const std::string& name, const std::string& query);
     MQ2DANNET_NODE_API void forget_all(const std::string& name);
     MQ2DANNET_NODE_API void forget_if(bool (*predicate)(const Observation& observation));
-    MQ2DANNET_NODE_API void update(const std::string& group, const std::string& data, const std::string& output);
-    MQ2DANNET_NODE_API const Observation read(const std::string& group);
-    MQ2DANNET_NODE_API const Observation read(const std::string& name, const std::string& query);
+    MQ2DANNET_NODE_API void update(const std::string& group, observed_value data, const std::string& output);
+    // observations are never modified once stored, so reading one only costs a reference (never null)
+    MQ2DANNET_NODE_API std::shared_ptr<const Observation> read(const std::string& group);
+    MQ2DANNET_NODE_API std::shared_ptr<const Observation> read(const std::string& name, const std::string& query);
     MQ2DANNET_NODE_API bool can_read(const std::string& name, const std::string& query);
+    // the rate and heartbeat we last asked name to observe query with, so that asking for the same again can be skipped
+    MQ2DANNET_NODE_API void observe_requested(const std::string& name, const std::string& query, unsigned int rate, unsigned int heartbeat);
+    MQ2DANNET_NODE_API bool observing_at(const std::string& name, const std::string& query, unsigned int rate, unsigned int heartbeat);
     MQ2DANNET_NODE_API size_t observed_count(const std::string& name);
     MQ2DANNET_NODE_API std::set<std::string> observed_queries(const std::string& name);
     MQ2DANNET_NODE_API size_t observer_count();
     MQ2DANNET_NODE_API std::set<std::string> observer_queries();
     MQ2DANNET_NODE_API std::set<std::string> observers(const std::string& query);
-    MQ2DANNET_NODE_API void publish(const std::string& group, const std::string& cmd, std::stringstream&& args);
-
-    template <typename T, typename... Args>
-    void publish(Args&&... args) {
-        std::map<unsigned int, Query> updated_values;
-
-        _observer_map.foreach ([this, &updated_values](std::pair<unsigned int, Query> observer) -> void {
-            const auto tick = MQGetTickCount64();
-            if (tick - observer.second.last >= std::max<unsigned __int64>(10 * observer.second.benchmark, observe_delay())) { // wait at least a second between updates
-                std::string group = observer_group(observer.first);
-                std::string query_result = parse_query(observer.second.query);
-
-				if (!_query_map.contains(observer.second.query) || _query_map.get(observer.second.query) != query_result) {
-                    _query_map.upsert(observer.second.query, query_result);
-                    shout<T>(group, query_result, std::forward<Args>(args)...);
-                }
-
-                Query new_query(observer.second.query);
-
-                const auto proc_time = MQGetTickCount64() - tick;
-                if (observer.second.benchmark == 0)
-                    new_query.benchmark = proc_time;
-                else
-                    new_query.benchmark = static_cast<unsigned __int64>(0.5 * (observer.second.benchmark + proc_time));
-
-                new_query.last = tick;
-
-                updated_values[observer.first] = new_query;
-            }
-        });
+    MQ2DANNET_NODE_API void publish(const std::string& group, const std::string& cmd, frame_buffer&& args);
+
+    // collects every due observer result for this pulse and sends them out, batched into one frame per observing peer
+    MQ2DANNET_NODE_API void publish_updates();
+
+    // what the actor knows about how a peer is keeping up, kept from ENTER until EXIT
+    struct peer_health final {
+        std::chrono::steady_clock::time_point last_seen; // last event of any kind from the peer
+        unsigned __int64 rtt = 0;                        // smoothed round trip in us, 0 until a probe comes back
+        unsigned __int64 last_rtt = 0;                   // us
+        unsigned __int64 probes = 0;                     // replies received
+        unsigned __int64 evasive = 0;
+        unsigned __int64 silent = 0;
+        unsigned __int64 messages_in = 0;
+        unsigned __int64 messages_out = 0; // whispers plus shouts to groups the peer is in
+    };
 
-        for (auto& updated_value : updated_values) {
-            _observer_map.upsert(updated_value.first, updated_value.second);
+    // sends a Probe to every peer that understands it, at most once per probe_interval
+    MQ2DANNET_NODE_API void probe_peers();
+    // false if the actor has nothing on peer (ourselves, or anyone not connected)
+    MQ2DANNET_NODE_API bool health(const std::string& peer, peer_health& health);
+    MQ2DANNET_NODE_API const std::list<std::string> get_peer_health();
+
+    // the last result received through Updates for an observed group, returns its sequence (0 if there isn't one)
+    MQ2DANNET_NODE_API unsigned __int64 last_sequence(const std::string& group, observed_value& result);
+    MQ2DANNET_NODE_API void sequence(const std::string& group, unsigned __int64 sequence, const observed_value& result);
+    // makes the next result for one of our observers go out in full
+    MQ2DANNET_NODE_API void resync(const std::string& group);
+
+    void clear_observer_cache() {
+        for (auto& observer : _observer_map) {
+            observer.second.result.clear();
         }
     }
 
-	void clear_observer_cache() {
-        _query_map.clear();
-	}
+    // incoming commands wait in one of these, interactive traffic (echoes, executes, queries and their responses) is
+    // always handled ahead of the bulk observer results
+    enum class lane : unsigned char {
+        Interactive,
+        Bulk,
+        Count
+    };
+
+    struct queued_command final {
+        name_ref command;
+        message args;
+        std::chrono::steady_clock::time_point queued;
+    };
 
 private:
+    host& _host;
     std::string _node_name;
 
     // we don't need anything crazy here, there is only a single actor so deadlocks won't be an issue (if we're not dumb about it)
@@ -273,37 +1541,6 @@ private:
         }
     };
 
-    template <typename T>
-    class locked_queue {
-    private:
-        std::mutex _mutex;
-        std::deque<T> _queue;
-
-    public:
-        //emplace empty front pop
-        template <class... Args>
-        void emplace(Args&&... args) {
-            std::scoped_lock<std::mutex> lock(_mutex);
-            _queue.emplace_front(std::forward<Args>(args)...);
-        }
-
-        T pop() {
-            std::scoped_lock<std::mutex> lock(_mutex);
-            T r;
-            if (!_queue.empty()) {
-                r = std::move(_queue.front());
-                _queue.pop_front(); // go ahead and pop it off, we've moved it
-            }
-            return r;
-        }
-
-        void remove_if(const std::function<bool(T&)>& f) {
-            std::scoped_lock<std::mutex> lock(_mutex);
-            // TODO: Confirm this is correct handling of the nodiscard / intention
-            static_cast<void>(std::remove_if(_queue.begin(), _queue.end(), f));
-        }
-    };
-
     template <typename T, typename U, typename V = std::less<T>>
     class locked_map {
     private:
@@ -368,13 +1605,24 @@ private:
             return r;
         }
 
-        void foreach (std::function<void(std::pair<T, U>)> f) {
+        void foreach (std::function<void(const std::pair<const T, U>&)> f) {
             std::scoped_lock<std::mutex> lock(_mutex);
             for (auto it = _map.begin(); it != _map.end(); ++it) {
                 f(*it);
             }
         }
 
+        // like upsert, but leaves the map alone if there's nothing under n. Returns whether there was.
+        bool update(const T& n, std::function<void(U&)> f) {
+            std::scoped_lock<std::mutex> lock(_mutex);
+            auto it = _map.find(n);
+            if (it == _map.end())
+                return false;
+
+            f(it->second);
+            return true;
+        }
+
         void erase_if(const T& n, std::function<bool(U&)> f) {
             std::scoped_lock<std::mutex> lock(_mutex);
             auto it = _map.find(n);
@@ -404,6 +1652,11 @@ private:
             r.insert(_map.cbegin(), _map.cend());
             return r;
         }
+
+        std::size_t size() {
+            std::scoped_lock<std::mutex> lock(_mutex);
+            return _map.size();
+        }
     };
 
     locked_vector<std::function<bool(const std::string&, const std::string&)>> _enter_callbacks;
@@ -411,70 +1664,104 @@ private:
     locked_vector<std::function<bool(const std::string&, const std::string&)>> _join_callbacks;
     locked_vector<std::function<bool(const std::string&, const std::string&)>> _leave_callbacks;
 
-    locked_map<std::string, std::string> _connected_peers;       // peer_name, peer_uuid
-    locked_map<std::string, std::set<std::string>> _peer_groups; // group name, peer_names
-    locked_set<std::string> _own_groups;                         // group name
+    std::shared_ptr<const membership> _membership = std::make_shared<const membership>(); // swapped whole, see snapshot()
+
+    // this is a private helper function ONLY THE STATIC ACTOR FUNCTION SHOULD CALL THIS
+    // copies the current membership, lets f change it and then publishes the copy as the new snapshot
+    void update_membership(const std::function<void(membership&)>& f);
 
     // I don't like this, but since zyre/czmq does the memory management for these, I should store these as raw pointers
-    zyre_t* _node;
-    zactor_t* _actor;
-    zpoller_t* _poller;
+    zyre_t* _node = nullptr;
+    zactor_t* _actor = nullptr;
+    zpoller_t* _poller = nullptr;
 
     // command containers
-    locked_map<std::string, std::function<bool(std::stringstream&& args)>> _command_map; // callback name, callback
-    locked_queue<std::pair<std::string, std::stringstream>> _command_queue;              // pair callback name, callback
-    locked_map<std::string, std::string> _query_map;                                     // query, result
+    locked_map<name_ref, std::function<bool(const message& args)>> _command_map; // callback name, callback
+    locked_map<name_ref, std::function<void(message& args)>> _command_decoders;  // callback name, decoder (actor side)
+    spsc_ring<queued_command, 4096> _command_queues[static_cast<size_t>(lane::Count)]; // one per lane (actor -> game thread)
+    locked_map<std::string, opcode> _command_opcodes;                                    // command name, v2 opcode
+    locked_map<opcode, name_ref> _opcode_commands;                                       // v2 opcode, command name
 
     locked_set<unsigned char> _response_keys; // ordered number of responses
 
+    // what one peer asked for when it started observing a query
+    struct observe_request final {
+        unsigned int rate = 0;      // 0 is observe_delay
+        unsigned int heartbeat = 0; // 0 is never
+        bool joined = false;        // has shown up in the observer group
+    };
+
     struct Query final {
         std::string query;
+        std::string expression; // ${query}, built once here instead of on every evaluation
         unsigned __int64 benchmark;
         unsigned __int64 last;
+        unsigned __int64 sequence;
+        unsigned __int64 due;  // tick this is next evaluated at, matches its entry in _observer_schedule
+        unsigned __int64 sent; // tick the result last went out
+        unsigned int rate;      // ms between evaluations, the fastest any current requester asked for (0 is observe_delay)
+        unsigned int heartbeat; // ms after which an unchanged result goes out again, the shortest asked for (0 is never)
+        unsigned __int64 refreshed; // membership generation rate and heartbeat were last worked out against
+        sent_result result;
+        std::map<std::string, observe_request> requests; // peer, what it asked for
 
         //Benchmarks[bmParseMacroParameter];
 
         Query() {
             benchmark = 0L;
             last = 0L;
+            sequence = 0L;
+            due = 0L;
+            sent = 0L;
+            rate = 0;
+            heartbeat = 0;
+            refreshed = 0;
         }
 
-        Query(const std::string& query) : query(query), benchmark(0), last(0) {}
+        Query(const std::string& query) : query(query), expression("${" + query + "}"), benchmark(0), last(0), sequence(0), due(0), sent(0), rate(0), heartbeat(0), refreshed(0) {}
 
         // let's do some copy and swap for a bit of easy optimization
         friend void swap(Query& left, Query& right) {
             using std::swap;
             swap(left.query, right.query);
+            swap(left.expression, right.expression);
             swap(left.benchmark, right.benchmark);
             swap(left.last, right.last);
+            swap(left.sequence, right.sequence);
+            swap(left.due, right.due);
+            swap(left.sent, right.sent);
+            swap(left.rate, right.rate);
+            swap(left.heartbeat, right.heartbeat);
+            swap(left.refreshed, right.refreshed);
+            swap(left.result, right.result);
+            swap(left.requests, right.requests);
         }
 
-        Query(const Query& other) : query(other.query), benchmark(other.benchmark), last(other.last) {}
-        Query(Query&& other) noexcept : query(std::move(other.query)), benchmark(std::move(other.benchmark)), last(std::move(other.last)) {}
+        Query(const Query& other) : query(other.query), expression(other.expression), benchmark(other.benchmark), last(other.last), sequence(other.sequence), due(other.due), sent(other.sent), rate(other.rate), heartbeat(other.heartbeat), refreshed(other.refreshed), result(other.result), requests(other.requests) {}
+        Query(Query&& other) noexcept : query(std::move(other.query)), expression(std::move(other.expression)), benchmark(std::move(other.benchmark)), last(std::move(other.last)), sequence(std::move(other.sequence)), due(std::move(other.due)), sent(std::move(other.sent)), rate(std::move(other.rate)), heartbeat(std::move(other.heartbeat)), refreshed(std::move(other.refreshed)), result(std::move(other.result)), requests(std::move(other.requests)) {}
         Query& operator=(Query rhs) {
             swap(*this, rhs);
             return *this;
         }
     };
 
+    // interned ids, so comparisons here are a couple of integer compares instead of string walks. Holding one keeps both
+    // names in the table
     struct Observed final {
-        std::string query;
-        std::string name;
+        name_ref query;
+        name_ref name;
 
         Observed() = default;
-        Observed(const std::string& query, const std::string& name) : query(query), name(name) {}
+        Observed(name_ref query, name_ref name) : query(std::move(query)), name(std::move(name)) {}
 
-        friend void swap(Observed& left, Observed& right) {
-            using std::swap;
-            swap(left.query, right.query);
-            swap(left.name, right.name);
+        // interns, for the paths that store
+        static Observed intern(const std::string& query, const std::string& name) {
+            return Observed(name_table::get().intern(query), name_table::get().intern(name));
         }
 
-        Observed(const Observed& other) : query(other.query), name(other.name) {}
-        Observed(Observed&& other) noexcept : query(std::move(other.query)), name(std::move(other.name)) {}
-        Observed& operator=(Observed rhs) {
-            swap(*this, rhs);
-            return *this;
+        // doesn't intern, for the paths that only read (a miss here shouldn't grow the table)
+        static Observed find(const std::string& query, const std::string& name) {
+            return Observed(name_table::get().find(query), name_table::get().find(name));
         }
     };
 
@@ -487,32 +1774,187 @@ private:
         }
     };
 
-    locked_map<unsigned int, Query> _observer_map;                    // group number, query
-    locked_map<Observed, std::string, ObservedCompare> _observed_map; // maps query to group (for data access)
-    locked_map<std::string, Observation> _observed_data;              // maps group to query result (could be empty)
+    std::map<unsigned int, Query> _observer_map;                      // group number, query (game thread only)
+
+    // observers ordered by when they are next due, so a pulse only looks at the ones it has to evaluate. Entries are
+    // never removed in place: one whose due doesn't match its observer anymore (or whose observer is gone) is skipped
+    // when it comes up. Only the game thread touches this.
+    struct scheduled_observer final {
+        unsigned __int64 due;
+        unsigned int key;
+
+        bool operator>(const scheduled_observer& rhs) const { return due > rhs.due; }
+    };
+
+    std::priority_queue<scheduled_observer, std::vector<scheduled_observer>, std::greater<scheduled_observer>> _observer_schedule;
+    std::unordered_map<std::string, unsigned int> _observer_keys; // query, group number (game thread only, same as the schedule)
+    bool _observer_schedule_stale = false; // rebuilt from _observer_map on the next pulse
+
+    struct observer_stats final {
+        unsigned __int64 pulses = 0;
+        unsigned __int64 evaluated = 0;
+        unsigned __int64 unchanged = 0; // evaluated, but matched what was last sent
+        unsigned __int64 skipped = 0; // dropped or rescheduled observers that came up
+        unsigned __int64 rebuilds = 0;
+        unsigned __int64 refreshes = 0; // requests worked out again because membership moved
+        unsigned __int64 nanoseconds = 0;
+    };
+
+    observer_stats _observer_stats;
+
+    void schedule_observers();
+
+    // works out rate and heartbeat from the peers still observing, anyone who has left the observer group is dropped
+    void refresh_requests(unsigned int key, Query& observer);
+    void refresh_requests(const std::string& group, Query& observer, const membership& current);
+
+    // how long after its last evaluation an observer is due again. Queries that are expensive to evaluate back off
+    // to ten times what they took, whatever the rate.
+    unsigned __int64 observer_interval(const Query& observer) {
+        return std::max<unsigned __int64>(10 * observer.benchmark, observer.rate ? observer.rate : observe_delay());
+    }
+    locked_map<Observed, name_ref, ObservedCompare> _observed_map;           // maps query to group (for data access)
+    locked_map<name_ref, std::shared_ptr<const Observation>> _observed_data; // maps group to query result (could be empty)
+
+    struct Sequenced final {
+        unsigned __int64 sequence = 0;
+        observed_value result;
+    };
+
+    locked_map<name_ref, Sequenced> _observed_sequences; // maps group to the last result received through Updates
+    std::map<std::pair<std::string, std::string>, std::pair<unsigned int, unsigned int>> _observe_rates; // (name, query), (rate, heartbeat) we asked for (game thread only)
 
     static void node_actor(zsock_t* pipe, void* args);
+    void push_command(zmsg_t* msg, const std::string& cmd, unsigned char version);
+    bool receive(zmsg_t* msg, const std::string& from, const std::string& group);
     const std::string observer_group(const unsigned int key);
-    void queue_command(const std::string& command, std::stringstream&& args);
+    std::shared_ptr<const Observation> read(const name_ref& group);
+    void queue_command(const name_ref& command, message&& args);
 
-    locked_map<Observed, Observation, ObservedCompare> _query_result_map; // maps query to result (for data access)
-    Observation _query_result;
+    static constexpr size_t query_result_limit = 256;
+    locked_map<Observed, std::shared_ptr<const Observation>, ObservedCompare> _query_result_map; // maps query to result (for data access), the oldest answers go past the limit
+    std::shared_ptr<const Observation> _query_result = std::make_shared<const Observation>();
 
     locked_set<std::string> _rejoin_groups;
 
-    bool _debugging;
-    bool _local_echo;
-    bool _command_echo;
-    bool _full_names;
-    bool _front_delimiter;
-    unsigned int _observe_delay;
-    unsigned int _keepalive;
-    unsigned int _evasive;
-    bool _evasive_refresh;
-    unsigned int _expired;
-    unsigned __int64 _last_group_check;
-    MQMacroBlock* _last_macro_check;
-    bool _show_groups;
+    // the plugin overwrites these from the ini, anything else gets the ini defaults
+    bool _debugging = false;
+    bool _local_echo = true;
+    bool _command_echo = true;
+    bool _full_names = true;
+    bool _front_delimiter = false;
+    unsigned int _observe_delay = 1000;
+    unsigned int _drain_budget = 2000;
+    unsigned int _keepalive = 30000;
+    unsigned int _evasive = 5000;
+    bool _evasive_refresh = false;
+    unsigned int _expired = 30000;
+    unsigned __int64 _last_group_check = 0;
+    const void* _last_macro_check = nullptr;
+    bool _show_groups = true;
+
+    // observer results sent: records is what would have been one message each, messages/bytes are what actually went out
+    struct update_stats final {
+        unsigned __int64 records = 0;
+        unsigned __int64 record_bytes = 0;
+        unsigned __int64 messages = 0;
+        unsigned __int64 bytes = 0;
+        unsigned __int64 resyncs = 0;
+    };
+
+    update_stats _update_stats;
+
+    // actor side pipe handling, written by the actor and read from the game thread
+    struct pipe_stats final {
+        std::atomic<unsigned __int64> commands{ 0 };
+        std::atomic<unsigned __int64> by_name{ 0 }; // didn't come in as an opcode
+        std::atomic<unsigned __int64> nanoseconds{ 0 };
+    };
+
+    pipe_stats _pipe_stats;
+
+    // actor side decoding of received messages
+    struct decode_stats final {
+        std::atomic<unsigned __int64> decoded{ 0 };
+        std::atomic<unsigned __int64> failed{ 0 };
+        std::atomic<unsigned __int64> nanoseconds{ 0 };
+    };
+
+    decode_stats _decode_stats;
+
+    // whisper routing, peer_uuids is only ever touched by the actor
+    std::unordered_map<std::string, std::string> _peer_uuids; // peer_name, peer_uuid (as zyre has it)
+
+    struct whisper_stats final {
+        std::atomic<unsigned __int64> sent{ 0 };
+        std::atomic<unsigned __int64> scanned{ 0 };    // not in peer_uuids, had to walk zyre_peers
+        std::atomic<unsigned __int64> unroutable{ 0 }; // no peer by that name
+        std::atomic<unsigned __int64> nanoseconds{ 0 };
+    };
+
+    whisper_stats _whisper_stats;
+
+    struct membership_stats final {
+        std::atomic<unsigned __int64> updates{ 0 };
+        std::atomic<unsigned __int64> nanoseconds{ 0 }; // copy, change and publish
+    };
+
+    membership_stats _membership_stats;
+
+    // raw name as typed, canonical forms of it. Names come through here from the TLO and every /d command. Only the
+    // game thread uses the cache (the actor works the odd name out itself), so it isn't locked, and it's dropped whole
+    // when it fills up or enter() finds we're on another server
+    struct canonical_name final {
+        std::string full;
+        std::string short_name;
+    };
+
+    static constexpr size_t name_cache_limit = 1024;
+    std::unordered_map<std::string, canonical_name> _name_cache;
+    std::string _server_name;     // as of enter(), so that nothing has to ask the host on every lookup
+    std::thread::id _game_thread; // the one enter() ran on
+
+    struct name_cache_stats final {
+        unsigned __int64 hits = 0;
+        unsigned __int64 misses = 0;
+        unsigned __int64 invalidations = 0; // server changed
+        unsigned __int64 evictions = 0;     // filled up
+    };
+
+    name_cache_stats _name_cache_stats;
+
+    canonical_name canonicalize(const std::string& name);
+    unsigned __int64 _update_serial = 0;
+
+    // game side command draining, one entry per pulse that had anything to do
+    struct drain_stats final {
+        unsigned __int64 pulses = 0;
+        unsigned __int64 commands = 0;
+        unsigned __int64 microseconds = 0;
+        unsigned __int64 exhausted = 0; // pulses that ran out of budget with commands still waiting
+        size_t last = 0;
+        size_t most = 0;
+    };
+
+    drain_stats _drain_stats;
+
+    // lane scheduling: this many interactive commands go before each bulk one when both are waiting, and a bulk command
+    // that has waited longer than the limit goes next regardless
+    static constexpr unsigned int interactive_weight = 4;
+    static constexpr std::chrono::milliseconds bulk_wait_limit{ 250 };
+    static constexpr unsigned int wait_buckets[] = { 1, 5, 20, 100, 500 }; // ms, plus everything above the last
+
+    struct lane_stats final {
+        unsigned __int64 handled = 0;
+        unsigned __int64 waits[std::size(wait_buckets) + 1] = {};
+        unsigned __int64 forced = 0; // handled early because it waited too long
+    };
+
+    lane_stats _lane_stats[static_cast<size_t>(lane::Count)];
+    unsigned int _interactive_credit = interactive_weight;
+
+    static lane command_lane(const name_ref& command);
+    size_t queued_commands();
 
     // explicitly prevent copy/move operations.
     Node(const Node&) = delete;
@@ -520,21 +1962,42 @@ private:
     Node(Node&&) = delete;
     Node& operator=(Node&&) = delete;
 
-    Node();
-    ~Node();
+    static constexpr std::chrono::milliseconds probe_interval{ 5000 };
+    std::chrono::steady_clock::time_point _last_probe;
+    locked_map<std::string, peer_health> _peer_health; // peer_name, health (only written by the actor)
+
+    static unsigned __int64 probe_clock() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // these are private helper functions ONLY THE STATIC ACTOR FUNCTION SHOULD CALL THESE
+    void seen(const std::string& peer, unsigned __int64 messages_in = 0);
+    void sent(const std::string& peer);
+    bool answer_probe(const std::string& from, zframe_t* body, unsigned char version);
 
     // this is a private helper function ONLY THE STATIC ACTOR FUNCTION SHOULD CALL THIS
     std::string peer_uuid(const std::string& name) {
         std::string full_name = get_full_name(name);
+        auto it = _peer_uuids.find(full_name);
+        if (it != _peer_uuids.end())
+            return it->second;
+
+        // we should have seen an ENTER for anyone we can talk to, so this is only a fallback
+        ++_whisper_stats.scanned;
         std::string uuid;
         zlist_t* peers = zyre_peers(_node);
 
         if (peers) {
             const char* z_peer = reinterpret_cast<const char*>(zlist_first(peers));
             while (z_peer) {
-                std::string peer_name(zyre_peer_header_value(_node, z_peer, "name"));
-                if (full_name == peer_name) {
+                char* peer_name = zyre_peer_header_value(_node, z_peer, "name");
+                const bool found = peer_name && full_name == init_string(peer_name);
+                if (peer_name)
+                    zstr_free(&peer_name);
+
+                if (found) {
                     uuid = z_peer;
+                    _peer_uuids[full_name] = uuid;
                     break;
                 }
 
@@ -556,25 +2019,32 @@ public:
         if (_node_name == get_full_name(peer))
             return true;
 
-        return _connected_peers.contains(get_full_name(peer));
+        return snapshot()->has_peer(get_full_name(peer));
     }
 
     size_t peers() {
-        return get_peers().size();
+        return snapshot()->names->size();
     }
 
     bool is_in_group(const std::string& group) {
-        auto groups = get_own_groups();
-        return groups.find(group) != groups.end();
+        const auto current = snapshot();
+        return current->own_groups->count(membership::id(group)) > 0;
     }
 
-    // smartly reads/sets/clears _current_query
-    Observation query(const std::string& name, const std::string& query);
-    Observation query();
+    // smartly reads/sets/clears _current_query. Shared like read(), so a TLO read doesn't copy the result
+    std::shared_ptr<const Observation> query(const std::string& name, const std::string& query);
+    std::shared_ptr<const Observation> query();
     void query_result(const std::string& name, const std::string& query, const Observation& obs);
     std::string trim_query(const std::string& query);
     std::string parse_query(const std::string& query);
-    MQTypeVar parse_response(const std::string& output, const std::string& data);
+
+    // what a response ended up as: the output variable's type and value once it took it, or a string when there's no
+    // output (or no macro) to put it in. type is empty and value is NULL when the output couldn't be found
+    struct stored_response final {
+        std::string type;
+        std::string value;
+    };
+    stored_response parse_response(const std::string& output, const std::string& data);
     std::string peer_address(const std::string& name);
 
     bool debugging(bool debugging) {
@@ -609,14 +2079,25 @@ public:
 
     unsigned int observe_delay(unsigned int observe_delay) {
         _observe_delay = observe_delay;
+        _observer_schedule_stale = true;
         return _observe_delay;
     }
     unsigned int observe_delay() { return _observe_delay; }
 
+    // time in microseconds each pulse is allowed to spend handling queued commands, 0 is one command per pulse
+    unsigned int drain_budget(unsigned int drain_budget) {
+        _drain_budget = drain_budget;
+        return _drain_budget;
+    }
+    unsigned int drain_budget() { return _drain_budget; }
+
+    size_t backlog() { return queued_commands(); }
+    size_t last_drained() { return _drain_stats.last; }
+
     unsigned int keepalive(unsigned int keepalive) {
         _keepalive = keepalive;
         if (_actor)
-            zstr_sendx(_actor, "KEEPALIVE", std::to_string(keepalive).c_str(), NULL);
+            send_pipe_command(_actor, pipe_command::Keepalive, { std::to_string(keepalive) });
         return _keepalive;
     }
     unsigned int keepalive() { return _keepalive; }
@@ -624,7 +2105,7 @@ public:
     unsigned int evasive(unsigned int evasive) {
         _evasive = evasive;
         if (_actor)
-            zstr_sendx(_actor, "EVASIVE", std::to_string(evasive).c_str(), NULL);
+            send_pipe_command(_actor, pipe_command::Evasive, { std::to_string(evasive) });
         return _evasive;
     }
     unsigned int evasive() { return _evasive; }
@@ -638,7 +2119,7 @@ public:
     unsigned int expired(unsigned int expired) {
         _expired = expired;
         if (_actor)
-            zstr_sendx(_actor, "EXPIRED", std::to_string(expired).c_str(), NULL);
+            send_pipe_command(_actor, pipe_command::Expired, { std::to_string(expired) });
         return _expired;
     }
     unsigned int expired() { return _expired; }
@@ -649,11 +2130,11 @@ public:
     }
     unsigned __int64 last_group_check() { return _last_group_check; }
 
-    MQMacroBlock* last_macro_check(MQMacroBlock* last_macro_check) {
+    const void* last_macro_check(const void* last_macro_check) {
         _last_macro_check = last_macro_check;
         return _last_macro_check;
     }
-    MQMacroBlock* last_macro_check() { return _last_macro_check; }
+    const void* last_macro_check() { return _last_macro_check; }
 
     bool show_groups(bool show_groups) {
         _show_groups = show_groups;
@@ -672,8 +2153,9 @@ public:
     void shutdown();
     void recv();
 
-    void do_next();
-    void remove_commands(const std::function<bool(std::pair<std::string, std::stringstream>&)>& f);
+    bool do_next();
+    void drain();
+    void remove_commands(const std::function<bool(queued_command&)>& f);
 };
 }
 
@@ -682,18 +2164,44 @@ public:
 #pragma region CommandDefs
 
 namespace MQ2DanNet {
-COMMAND(Echo, const std::string& message)
+COMMAND(Echo, (std::string_view /* text */), const std::string& message)
 
-COMMAND(Execute, const std::string& command)
+COMMAND(Execute, (std::string_view /* command */), const std::string& command)
 
 // NOTE: Query is asynchronous
-COMMAND(Query, const std::string& request)
+COMMAND(Query, (std::string_view /* response key */, std::string_view /* request */), const std::string& request)
+using QueryResponse = fields<std::string_view /* result */>;
+
+COMMAND(Observe, (std::string_view /* response key */, std::string_view /* query */), const std::string& query, const std::string& output, unsigned int rate, unsigned int heartbeat)
+using ObserveResponse = fields<std::string /* observer group */, std::string_view /* result */>;
+// follows the body if either is set (older peers stop reading after the query, so they just keep their own cadence).
+// rate is how often the query is evaluated in ms (0 is the observed peer's observe delay), and the result only goes out
+// when it changed, or when it hasn't gone out for heartbeat ms (0 is never)
+using ObserveRate = fields<unsigned int /* rate */, unsigned int /* heartbeat */>;
 
-COMMAND(Observe, const std::string& query, const std::string& output)
+COMMAND(Update, (std::string_view /* result */), const std::string& result)
 
-COMMAND(Update, const std::string& result)
+COMMAND(Reupdate, ())
 
-COMMAND(Reupdate)
+// one observer result as it goes out in Updates
+struct update_record final {
+    std::string result;
+    std::string previous;      // the result with sequence - 1, empty if there isn't one to delta against
+    unsigned __int64 sequence; // per observer, increases with every result sent
+};
+
+// batched Update, records is group -> record. serial increases with every batch a node sends, so that the receiver can
+// apply batches that queued up in the order they were sent. Only sent to peers on wire_v3.
+// the body is the serial followed by UpdatesRecord and a write_value() value for each record
+COMMAND(Updates, (unsigned __int64 /* serial */), unsigned __int64 serial, const std::map<std::string, update_record>& records)
+using UpdatesRecord = fields<std::string /* group */, unsigned __int64 /* sequence */>;
+
+// sent back to an observed peer when Updates skipped a sequence we needed for a delta, asks for the full result again
+COMMAND(Resync, (std::string /* group */), const std::set<std::string>& groups) // body repeats for each group
+
+// round trip timer, only sent to peers on wire_v4. Never reaches the game thread on either end: the peer's actor sends it
+// straight back with reply set, and ours works out the round trip from the echoed stamp.
+COMMAND(Probe, (bool /* reply */, unsigned __int64 /* sent, us on the sender's steady clock */), bool reply, unsigned __int64 sent)
 }
 
 #pragma endregion
@@ -702,85 +2210,417 @@ using namespace MQ2DanNet;
 
 #pragma region Node
 
-MQ2DANNET_NODE_API Node& Node::get() {
-    static Node instance;
-    return instance;
+MQ2DANNET_NODE_API void Node::join(const std::string& group) {
+    if (_actor) {
+        zmsg_t* msg = zmsg_new();
+        zmsg_pushstr(msg, group.c_str());
+        push_pipe_command(msg, pipe_command::Join);
+        zmsg_send(&msg, _actor);
+    }
 }
 
-MQ2DANNET_NODE_API void Node::join(const std::string& group) {
+MQ2DANNET_NODE_API void Node::leave(const std::string& group) {
     if (_actor) {
         zmsg_t* msg = zmsg_new();
         zmsg_pushstr(msg, group.c_str());
-        zmsg_pushstr(msg, "JOIN");
+        push_pipe_command(msg, pipe_command::Leave);
         zmsg_send(&msg, _actor);
     }
 }
 
-MQ2DANNET_NODE_API void Node::leave(const std::string& group) {
-    if (_actor) {
-        zmsg_t* msg = zmsg_new();
-        zmsg_pushstr(msg, group.c_str());
-        zmsg_pushstr(msg, "LEAVE");
-        zmsg_send(&msg, _actor);
+MQ2DANNET_NODE_API void MQ2DanNet::Node::on_join(std::function<bool(const std::string&, const std::string&)> callback) {
+    _join_callbacks.push_back(std::move(callback));
+}
+
+MQ2DANNET_NODE_API void MQ2DanNet::Node::on_leave(std::function<bool(const std::string&, const std::string&)> callback) {
+    _leave_callbacks.push_back(std::move(callback));
+}
+
+MQ2DANNET_NODE_API void Node::publish(const std::string& group, const std::string& cmd, frame_buffer&& args) {
+    if (!_actor)
+        return;
+
+    const unsigned char version = args.version();
+    zframe_t* args_frame = args.to_frame();
+
+    zmsg_t* msg = zmsg_new();
+    zmsg_prepend(msg, &args_frame);
+    push_command(msg, cmd, version);
+
+    zmsg_pushstr(msg, group.c_str());
+    push_pipe_command(msg, pipe_command::Shout);
+
+    zmsg_send(&msg, _actor);
+}
+
+MQ2DANNET_NODE_API void Node::respond(const std::string& name, const std::string& cmd, frame_buffer&& args) {
+    if (!_actor)
+        return;
+
+    const unsigned char version = args.version();
+    zframe_t* args_frame = args.to_frame();
+
+    zmsg_t* msg = zmsg_new();
+    zmsg_prepend(msg, &args_frame);
+    push_command(msg, cmd, version);
+
+    zmsg_pushstr(msg, name.c_str());
+    push_pipe_command(msg, pipe_command::Whisper);
+
+    zmsg_send(&msg, _actor);
+}
+
+void Node::schedule_observers() {
+    decltype(_observer_schedule) schedule;
+    for (auto& observer : _observer_map) {
+        // the delay may have changed since this was worked out
+        refresh_requests(observer.first, observer.second);
+        observer.second.due = observer.second.last ? observer.second.last + observer_interval(observer.second) : 0;
+        schedule.push(scheduled_observer{ observer.second.due, observer.first });
+    }
+
+    _observer_schedule.swap(schedule);
+    _observer_schedule_stale = false;
+    ++_observer_stats.rebuilds;
+}
+
+MQ2DANNET_NODE_API void Node::publish_updates() {
+    std::map<std::string, update_record> results; // group, result
+
+    const auto start = std::chrono::steady_clock::now();
+    if (_observer_schedule_stale)
+        schedule_observers();
+
+    // one snapshot for the whole pulse. Requests only change with membership (or through register_observer, which works
+    // them out itself), so an observer only looks at them again once the generation has moved
+    const auto current = snapshot();
+
+    ++_observer_stats.pulses;
+    while (!_observer_schedule.empty() && _observer_schedule.top().due <= _host.tick()) {
+        const scheduled_observer next = _observer_schedule.top();
+        _observer_schedule.pop();
+
+        auto it = _observer_map.find(next.key);
+        if (it == _observer_map.end() || it->second.due != next.due) {
+            ++_observer_stats.skipped;
+            continue;
+        }
+
+        Query& observer = it->second;
+        std::string group;
+        if (observer.refreshed != current->generation) {
+            group = observer_group(next.key);
+            refresh_requests(group, observer, *current);
+            ++_observer_stats.refreshes;
+        }
+
+        const auto tick = _host.tick();
+        std::string query_result = _host.evaluate(observer.expression);
+
+        // only the evaluation counts towards the backoff, not the diffing and storing that follows it
+        const auto proc_time = _host.tick() - tick;
+
+        // an observer without a valid result (new, reupdated or resynced) goes out in full, anything else only when it
+        // changed or its heartbeat is up
+        if (!observer.result.matches(query_result) || (observer.heartbeat && tick - observer.sent >= observer.heartbeat)) {
+            std::string previous(observer.result.previous());
+            observer.result.store(query_result);
+            if (group.empty())
+                group = observer_group(next.key);
+            results[std::move(group)] = update_record{ std::move(query_result), std::move(previous), ++observer.sequence };
+            observer.sent = tick;
+        } else {
+            ++_observer_stats.unchanged;
+        }
+
+        if (observer.benchmark == 0)
+            observer.benchmark = proc_time;
+        else
+            observer.benchmark = static_cast<unsigned __int64>(0.5 * (observer.benchmark + proc_time));
+
+        observer.last = tick;
+        observer.due = tick + observer_interval(observer);
+        _observer_schedule.push(scheduled_observer{ observer.due, next.key });
+
+        ++_observer_stats.evaluated;
+    }
+
+    _observer_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (results.empty())
+        return;
+
+    // anything observed by a peer that can't read Updates still gets its own shout, everything else is regrouped by peer
+    std::map<name_ref, std::map<std::string, update_record>> batches; // peer, group, record
+    for (auto& result : results) {
+        const unsigned char version = group_wire_version(result.first);
+        ++_update_stats.records;
+        _update_stats.record_bytes += frame_buffer::field_size(result.second.result.size(), version);
+
+        if (version < wire_v3) {
+            frame_buffer frame = pack<Update>(version, result.first, result.second.result);
+            ++_update_stats.messages;
+            _update_stats.bytes += frame.size();
+            publish(result.first, name<Update>(), std::move(frame));
+            continue;
+        }
+
+        // we are in there too if we observe ourselves, but that one is delivered locally below
+        const name_ref group = membership::id(result.first);
+        for (auto& peer : current->group_members(group)) {
+            if (peer != current->self)
+                batches[peer][result.first] = result.second;
+        }
+
+        // we are observing ourselves, so deliver it locally (Update::pack does this for the unbatched case)
+        if (current->own_groups->count(group)) {
+            frame_buffer self_send;
+            Update::body::encode(self_send, result.second.result);
+            Update::callback(message(*this, _node_name, result.first, std::move(self_send)));
+        }
+    }
+
+    ++_update_serial;
+    for (auto& batch : batches) {
+        const std::string& peer = batch.first.str();
+        frame_buffer frame = pack<Updates>(peer_wire_version(peer), peer, _update_serial, batch.second);
+        ++_update_stats.messages;
+        _update_stats.bytes += frame.size();
+        respond(peer, name<Updates>(), std::move(frame));
+    }
+}
+
+MQ2DANNET_NODE_API unsigned __int64 Node::last_sequence(const std::string& group, observed_value& result) {
+    Sequenced sequenced = _observed_sequences.get(name_table::get().find(group));
+    result = std::move(sequenced.result);
+    return sequenced.sequence;
+}
+
+MQ2DANNET_NODE_API void Node::sequence(const std::string& group, unsigned __int64 sequence, const observed_value& result) {
+    _observed_sequences.upsert(name_table::get().intern(group), Sequenced{ sequence, result });
+}
+
+MQ2DANNET_NODE_API void Node::resync(const std::string& group) {
+    // our observer groups are `<our name>_<key>`, so the key can be read straight off the group
+    const std::string prefix = _node_name + "_";
+    if (group.size() <= prefix.size() || group.compare(0, prefix.size(), prefix) != 0)
+        return;
+
+    const std::string key = group.substr(prefix.size());
+    if (!std::all_of(key.cbegin(), key.cend(), [](char c) { return c >= '0' && c <= '9'; }))
+        return;
+
+    auto it = _observer_map.find(static_cast<unsigned int>(std::strtoul(key.c_str(), nullptr, 10)));
+    if (it != _observer_map.end()) {
+        it->second.result.clear();
+        ++_update_stats.resyncs;
+    }
+}
+
+void Node::push_command(zmsg_t* msg, const std::string& cmd, unsigned char version) {
+    if (version < wire_v2) {
+        zmsg_pushstr(msg, cmd.c_str());
+        return;
+    }
+
+    static const std::string response_prefix = "response_";
+
+    // NUL marker, opcode, then either the response key or (for anything without an opcode) the command name
+    std::string command(2, '\0');
+    if (cmd.compare(0, response_prefix.size(), response_prefix) == 0) {
+        command[1] = static_cast<char>(opcode::Response);
+        char key_buf[10];
+        command.append(key_buf, encode_varint(std::strtoull(cmd.c_str() + response_prefix.size(), nullptr, 10), key_buf));
+    } else {
+        const opcode code = _command_opcodes.get(cmd);
+        command[1] = static_cast<char>(code);
+        if (code == opcode())
+            command += cmd;
+    }
+
+    zmsg_pushmem(msg, command.data(), command.size());
+}
+
+bool Node::receive(zmsg_t* msg, const std::string& from, const std::string& group) {
+    zframe_t* command_frame = zmsg_first(msg);
+    if (!command_frame)
+        return false;
+
+    const char* pos = reinterpret_cast<const char*>(zframe_data(command_frame));
+    const char* end = pos + zframe_size(command_frame);
+
+    // only look names up, anything we never registered has no handler anyway and shouldn't grow the name table
+    name_ref command;
+    unsigned char version = wire_v1;
+    if (end - pos >= 2 && *pos == '\0') {
+        // NUL marker, opcode, then either the response key or the command name
+        version = wire_v2;
+        ++pos;
+        const opcode code = static_cast<opcode>(*pos++);
+        if (code == opcode::Response) {
+            unsigned __int64 key = 0;
+            if (!decode_varint(pos, end, key))
+                return false;
+            command = name_table::get().find("response_" + std::to_string(key));
+        } else if (code == opcode::Probe) {
+            // answered right here so that the round trip doesn't include either game thread
+            zframe_t* body = zmsg_next(msg);
+            return body && answer_probe(from, body, version);
+        } else if (code == opcode()) {
+            command = name_table::get().find(std::string_view(pos, end - pos));
+        } else {
+            command = _opcode_commands.get(code);
+        }
+    } else {
+        command = name_table::get().find(std::string_view(pos, end - pos));
+    }
+
+    if (!command)
+        return false;
+
+    // hand the body frame over as-is, handlers read their fields out of it in place
+    zframe_t* body = zmsg_next(msg);
+    if (!body)
+        return false;
+
+    zmsg_remove(msg, body);
+    message args(*this, from, group, body, version);
+
+    auto decoder = _command_decoders.get(command);
+    if (decoder) {
+        const auto start = std::chrono::steady_clock::now();
+        try {
+            decoder(args);
+        } catch (std::runtime_error&) {
+            ++_decode_stats.failed;
+            return false;
+        }
+
+        ++_decode_stats.decoded;
+        _decode_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
     }
+
+    queue_command(command, std::move(args));
+    return true;
 }
 
-MQ2DANNET_NODE_API void MQ2DanNet::Node::on_join(std::function<bool(const std::string&, const std::string&)> callback) {
-    _join_callbacks.push_back(std::move(callback));
+void Node::seen(const std::string& peer, unsigned __int64 messages_in) {
+    const auto now = std::chrono::steady_clock::now();
+    _peer_health.upsert(peer, [now, messages_in](peer_health& health) -> void {
+        health.last_seen = now;
+        health.messages_in += messages_in;
+    });
 }
 
-MQ2DANNET_NODE_API void MQ2DanNet::Node::on_leave(std::function<bool(const std::string&, const std::string&)> callback) {
-    _leave_callbacks.push_back(std::move(callback));
+void Node::sent(const std::string& peer) {
+    _peer_health.update(peer, [](peer_health& health) -> void {
+        ++health.messages_out;
+    });
 }
 
-MQ2DANNET_NODE_API void Node::publish(const std::string& group, const std::string& cmd, std::stringstream&& args) {
-    if (!_actor)
-        return;
+bool Node::answer_probe(const std::string& from, zframe_t* body, unsigned char version) {
+    frame_reader reader(reinterpret_cast<const char*>(zframe_data(body)), zframe_size(body), version);
+    bool reply = false;
+    unsigned __int64 stamp = 0;
+    try {
+        std::tie(reply, stamp) = Probe::body::decode(reader);
+    } catch (std::runtime_error&) {
+        return false;
+    }
+
+    if (reply) {
+        const unsigned __int64 now = probe_clock();
+        if (stamp > now)
+            return false;
 
-    args.seekg(0, args.end);
-    size_t args_size = (size_t)args.tellg();
-    args.seekg(0, args.beg);
+        // smoothed the same way tcp does it, each new sample counts for an eighth
+        const unsigned __int64 sample = now - stamp;
+        _peer_health.update(from, [sample](peer_health& health) -> void {
+            health.rtt = health.probes ? (health.rtt * 7 + sample) / 8 : sample;
+            health.last_rtt = sample;
+            ++health.probes;
+        });
+        return true;
+    }
 
-    char* args_buf = new char[args_size];
-    args.read(args_buf, args_size);
+    const std::string uuid = peer_uuid(from);
+    if (uuid.empty())
+        return false;
 
-    zframe_t* args_frame = zframe_new(args_buf, args_size);
+    frame_buffer frame(version);
+    Probe::body::encode(frame, true, stamp);
+    zframe_t* reply_frame = frame.to_frame();
 
-    zmsg_t* msg = zmsg_new();
-    zmsg_prepend(msg, &args_frame);
-    zmsg_pushstr(msg, cmd.c_str());
+    zmsg_t* out = zmsg_new();
+    zmsg_prepend(out, &reply_frame);
+    push_command(out, name<Probe>(), version);
+    zyre_whisper(_node, uuid.c_str(), &out);
+    return true;
+}
 
-    zmsg_pushstr(msg, group.c_str());
-    zmsg_pushstr(msg, "SHOUT");
+MQ2DANNET_NODE_API void Node::probe_peers() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _last_probe < probe_interval)
+        return;
 
-    zmsg_send(&msg, _actor);
+    _last_probe = now;
+    const unsigned __int64 stamp = probe_clock();
+    // hold on to the snapshot, the actor can publish a new one while we're going through it
+    const auto current = snapshot();
+    for (auto& peer : *current->protocols) {
+        if (peer.second >= wire_v4)
+            whisper<Probe>(peer.first.str(), false, stamp);
+    }
+}
 
-    delete[] args_buf;
+MQ2DANNET_NODE_API bool Node::health(const std::string& peer, peer_health& health) {
+    return _peer_health.update(get_full_name(peer), [&health](peer_health& current) -> void {
+        health = current;
+    });
 }
 
-MQ2DANNET_NODE_API void Node::respond(const std::string& name, const std::string& cmd, std::stringstream&& args) {
-    if (!_actor)
-        return;
+MQ2DANNET_NODE_API const std::list<std::string> Node::get_peer_health() {
+    std::list<std::string> output;
+    const auto now = std::chrono::steady_clock::now();
 
-    args.seekg(0, args.end);
-    size_t args_size = (size_t)args.tellg();
-    args.seekg(0, args.beg);
+    for (auto& peer : _peer_health.copy()) {
+        const peer_health& health = peer.second;
+
+        std::stringstream peer_stream;
+        peer_stream << " :: \ax\ag" << get_name(peer.first) << "\ax ";
+        if (health.probes)
+            peer_stream << "rtt " << health.rtt / 1000.0 << " ms (last " << health.last_rtt / 1000.0 << "), ";
+        else
+            peer_stream << "rtt unknown, ";
 
-    char* args_buf = new char[args_size];
-    args.read(args_buf, args_size);
+        peer_stream << "seen " << std::chrono::duration_cast<std::chrono::milliseconds>(now - health.last_seen).count() << " ms ago, "
+                    << health.evasive << " evasive, " << health.silent << " silent, "
+                    << health.messages_in << " in, " << health.messages_out << " out";
+        output.push_back(peer_stream.str());
+    }
 
-    zframe_t* args_frame = zframe_new(args_buf, args_size);
+    return output;
+}
 
-    zmsg_t* msg = zmsg_new();
-    zmsg_prepend(msg, &args_frame);
-    zmsg_pushstr(msg, cmd.c_str());
+MQ2DANNET_NODE_API unsigned char Node::peer_wire_version(const std::string& peer) {
+    const auto current = snapshot();
+    auto it = current->protocols->find(membership::id(get_full_name(peer)));
+    return it != current->protocols->end() && it->second > wire_v1 ? it->second : wire_v1;
+}
 
-    zmsg_pushstr(msg, name.c_str());
-    zmsg_pushstr(msg, "WHISPER");
+MQ2DANNET_NODE_API unsigned char Node::group_wire_version(const std::string& group) {
+    const auto current = snapshot();
+    auto group_it = current->group_peers->find(membership::id(group));
+    if (group_it == current->group_peers->end())
+        return wire_version;
 
-    zmsg_send(&msg, _actor);
+    unsigned char version = wire_version;
+    for (const auto& peer : *group_it->second) {
+        auto it = current->protocols->find(peer);
+        version = std::min(version, it != current->protocols->end() && it->second > wire_v1 ? it->second : static_cast<unsigned char>(wire_v1));
+    }
 
-    delete[] args_buf;
+    return version;
 }
 
 MQ2DANNET_NODE_API const std::list<std::string> Node::get_info() {
@@ -788,23 +2628,23 @@ MQ2DANNET_NODE_API const std::list<std::string> Node::get_info() {
         return std::list<std::string>{ "NONET" };
 
     std::list<std::string> output;
-    std::set<std::string> groups = get_own_groups();
+    const auto current = snapshot();
+    const std::set<std::string>& groups = current->own_group_names();
     output.push_back("CHANNELS: ");
-    auto group_peers = get_group_peers();
-    for (auto group : group_peers) {
+    for (auto& group : current->group_names()) {
         // this is our "observer" group filter
-        if (group.first.find_first_of('_') != std::string::npos && std::isdigit(group.first.back()))
+        if (group.find_first_of('_') != std::string::npos && std::isdigit(group.back()))
             continue;
 
         std::stringstream output_stream;
 
-        if (groups.find(group.first) != groups.end()) {
-            output_stream << " :: \ax\ag" << group.first << "\ax" << std::endl;
+        if (groups.find(group) != groups.end()) {
+            output_stream << " :: \ax\ag" << group << "\ax" << std::endl;
         } else {
-            output_stream << " :: \ax\a-g" << group.first << "\ax" << std::endl;
+            output_stream << " :: \ax\a-g" << group << "\ax" << std::endl;
         }
 
-        for (auto peer : group.second) {
+        for (auto& peer : membership::strings(current->group_members(group))) {
             if (_node_name == peer)
                 output_stream << "\ax\aw";
             else
@@ -820,59 +2660,150 @@ MQ2DANNET_NODE_API const std::list<std::string> Node::get_info() {
     return output;
 }
 
-MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_peers() {
-    std::set<std::string> peers = _connected_peers.keys();
-    peers.emplace(_node_name);
+MQ2DANNET_NODE_API const std::list<std::string> Node::get_stats() {
+    std::list<std::string> output;
+
+    const frame_buffer::stats frames = frame_buffer::pool_stats();
+    std::stringstream frame_stream;
+    frame_stream << " :: \ax\agframes\ax " << frames.frames << " sent, " << frames.bytes << " bytes, "
+                 << frames.reused << "/" << frames.acquired << " buffers reused (" << frames.pooled << " pooled)";
+    output.push_back(frame_stream.str());
+
+    const unsigned __int64 observer_pulses = _observer_stats.pulses;
+    std::stringstream observer_stream;
+    observer_stream << " :: \ax\agobservers\ax " << _observer_schedule.size() << " scheduled, " << _observer_stats.evaluated << " evaluated (" << _observer_stats.unchanged << " unchanged) over "
+                    << observer_pulses << " pulses (" << (observer_pulses ? _observer_stats.nanoseconds / observer_pulses : 0) << " ns per pulse), "
+                    << _observer_stats.skipped << " stale, " << _observer_stats.rebuilds << " rebuilds, " << _observer_stats.refreshes << " refreshes";
+    output.push_back(observer_stream.str());
+
+    std::stringstream update_stream;
+    update_stream << " :: \ax\agupdates\ax " << _update_stats.records << " results (" << _update_stats.record_bytes << " bytes unbatched) sent as "
+                  << _update_stats.messages << " messages (" << _update_stats.bytes << " bytes), "
+                  << _update_stats.resyncs << " resyncs";
+    output.push_back(update_stream.str());
+
+    const unsigned __int64 pipe_commands = _pipe_stats.commands;
+    std::stringstream pipe_stream;
+    pipe_stream << " :: \ax\agpipe\ax " << pipe_commands << " commands (" << _pipe_stats.by_name << " by name), "
+                << (pipe_commands ? _pipe_stats.nanoseconds / pipe_commands : 0) << " ns each";
+    output.push_back(pipe_stream.str());
+
+    const unsigned __int64 decoded = _decode_stats.decoded;
+    std::stringstream decode_stream;
+    decode_stream << " :: \ax\agdecode\ax " << decoded << " decoded ahead of the game thread, " << _decode_stats.failed << " malformed, "
+                  << (decoded ? _decode_stats.nanoseconds / decoded : 0) << " ns each";
+    output.push_back(decode_stream.str());
+
+    const unsigned __int64 lookups = _whisper_stats.sent + _whisper_stats.unroutable;
+    std::stringstream whisper_stream;
+    whisper_stream << " :: \ax\agwhispers\ax " << _whisper_stats.sent << " sent, " << _whisper_stats.unroutable << " unroutable, "
+                   << _whisper_stats.scanned << " looked up by scanning peers, " << (lookups ? _whisper_stats.nanoseconds / lookups : 0) << " ns per lookup";
+    output.push_back(whisper_stream.str());
+
+    std::stringstream name_stream;
+    const unsigned __int64 name_lookups = _name_cache_stats.hits + _name_cache_stats.misses;
+    name_stream << " :: \ax\agnames\ax " << name_table::get().size() << " interned (" << name_table::get().dropped() << " dropped), " << _name_cache.size() << "/" << name_cache_limit << " canonical cached, "
+                << _name_cache_stats.hits << "/" << name_lookups << " hits (" << (name_lookups ? _name_cache_stats.hits * 100 / name_lookups : 0) << "%), "
+                << _name_cache_stats.invalidations << " server changes, " << _name_cache_stats.evictions << " times full";
+    output.push_back(name_stream.str());
+
+    static const char* lane_names[] = { "interactive", "bulk" };
+    for (size_t idx = 0; idx < static_cast<size_t>(lane::Count); ++idx) {
+        const auto& queue = _command_queues[idx];
+        const lane_stats& stats = _lane_stats[idx];
+
+        std::stringstream queue_stream;
+        queue_stream << " :: \ax\agqueue\ax " << lane_names[idx] << " " << queue.size() << "/" << queue.capacity() << " waiting, "
+                     << queue.high_water() << " high water, " << queue.overflows() << " dropped, " << stats.handled << " handled";
+        if (stats.forced)
+            queue_stream << " (" << stats.forced << " overdue)";
+        queue_stream << ", waited";
+        for (size_t bucket = 0; bucket < std::size(wait_buckets); ++bucket) {
+            queue_stream << " <" << wait_buckets[bucket] << "ms:" << stats.waits[bucket];
+        }
+        queue_stream << " more:" << stats.waits[std::size(wait_buckets)];
+        output.push_back(queue_stream.str());
+    }
+
+    std::stringstream drain_stream;
+    drain_stream << " :: \ax\agdrain\ax " << _drain_budget << " us budget, " << _drain_stats.commands << " commands over " << _drain_stats.pulses << " pulses ("
+                 << (_drain_stats.pulses ? _drain_stats.commands / _drain_stats.pulses : 0) << " avg, " << _drain_stats.most << " most, "
+                 << (_drain_stats.pulses ? _drain_stats.microseconds / _drain_stats.pulses : 0) << " us avg, "
+                 << (_drain_stats.commands ? _drain_stats.microseconds * 1000 / _drain_stats.commands : 0) << " us per 1000), "
+                 << _drain_stats.exhausted << " out of budget";
+    output.push_back(drain_stream.str());
+
+    const auto current = snapshot();
+    std::map<unsigned char, size_t> versions;
+    for (auto& peer : *current->protocols) {
+        ++versions[peer.second];
+    }
 
-    return peers;
+    std::stringstream protocol_stream;
+    protocol_stream << " :: \ax\agprotocol\ax v" << static_cast<unsigned int>(wire_version) << ", " << current->peers->size() << " peers";
+    for (auto& version : versions) {
+        protocol_stream << ", " << version.second << " on v" << static_cast<unsigned int>(version.first);
+    }
+    protocol_stream << ", membership generation " << current->generation;
+    output.push_back(protocol_stream.str());
+
+    const unsigned __int64 membership_updates = _membership_stats.updates;
+    std::stringstream membership_stream;
+    membership_stream << " :: \ax\agmembership\ax " << current->groups->size() << " groups, " << current->peer_groups->size() << " peers in groups, "
+                      << membership_updates << " updates, " << (membership_updates ? _membership_stats.nanoseconds / membership_updates : 0) << " ns each";
+    output.push_back(membership_stream.str());
+
+    return output;
 }
 
-MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_all_groups() {
-    std::set<std::string> groups = _peer_groups.keys();
-    std::set<std::string> own_groups = _own_groups.copy();
-    groups.insert(own_groups.cbegin(), own_groups.cend());
+// these all copy out of the current snapshot as strings, use snapshot() directly to avoid the copy
+MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_peers() {
+    return snapshot()->peer_names();
+}
 
-    return groups;
+MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_all_groups() {
+    return snapshot()->group_names();
 }
 
 MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_own_groups() {
-    return _own_groups.copy();
+    return snapshot()->own_group_names();
 }
 
 MQ2DANNET_NODE_API const std::map<std::string, std::set<std::string>> MQ2DanNet::Node::get_group_peers() {
-    std::map<std::string, std::set<std::string>> group_peers;
-
-    std::set<std::string> groups = get_all_groups();
-    for (auto group : groups) {
-        group_peers[group] = get_group_peers(group);
+    std::map<std::string, std::set<std::string>> r;
+    const auto current = snapshot();
+    for (auto& group : *current->members) {
+        r.emplace(group.first.str(), membership::strings(*group.second));
     }
 
-    return group_peers;
+    return r;
 }
 
 MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_group_peers(const std::string& group) {
-    std::set<std::string> peers = _peer_groups.get(group);
-
-    if (is_in_group(group))
-        peers.emplace(_node_name);
-
-    return peers;
+    return membership::strings(snapshot()->group_members(group));
 }
 
 MQ2DANNET_NODE_API const std::set<std::string> MQ2DanNet::Node::get_peer_groups(const std::string& peer) {
-    std::set<std::string> groups;
+    return membership::strings(snapshot()->groups_of(peer));
+}
 
-    _peer_groups.foreach ([&groups, peer](std::pair<std::string, std::set<std::string>> p) -> void {
-        if (p.second.find(peer) != p.second.end())
-            groups.emplace(p.first);
-    });
+void Node::update_membership(const std::function<void(membership&)>& f) {
+    const auto start = std::chrono::steady_clock::now();
+
+    auto next = std::make_shared<membership>(*snapshot());
+    next->rename_self(_node_name);
+    f(*next);
+
+    ++next->generation;
+    std::atomic_store(&_membership, std::shared_ptr<const membership>(std::move(next)));
 
-    return groups;
+    ++_membership_stats.updates;
+    _membership_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 }
 
 MQ2DANNET_NODE_API const std::string MQ2DanNet::Node::get_interfaces() {
     const char* const current_iface = zsys_interface();
-    const unsigned int current_iface_idx = (strlen(current_iface) == 1 && current_iface[0] >= '0' && current_iface[0] <= '9') ? GetIntFromString(current_iface, 0) : strlen(current_iface) == 0 ? 0 : -1;
+    const unsigned int current_iface_idx = (strlen(current_iface) == 1 && current_iface[0] >= '0' && current_iface[0] <= '9') ? current_iface[0] - '0' : strlen(current_iface) == 0 ? 0 : -1;
 
     ziflist_t* l = ziflist_new_ipv6();
     std::string ifaces;
@@ -900,26 +2831,58 @@ MQ2DANNET_NODE_API const std::string MQ2DanNet::Node::get_interfaces() {
 }
 
 MQ2DANNET_NODE_API const std::string MQ2DanNet::Node::get_full_name(const std::string& name) {
-    std::string ret = name;
+    return canonicalize(name).full;
+}
+
+MQ2DANNET_NODE_API const std::string MQ2DanNet::Node::get_short_name(const std::string& name) {
+    return canonicalize(name).short_name;
+}
+
+Node::canonical_name Node::canonicalize(const std::string& name) {
+    const bool cached = !_server_name.empty() && std::this_thread::get_id() == _game_thread;
+
+    // until something has entered there's no server to go on but the host's
+    std::string entering;
+    const std::string& server = !_server_name.empty() ? _server_name : (entering = _host.server_name());
+
+    if (cached) {
+        auto it = _name_cache.find(name);
+        if (it != _name_cache.end()) {
+            ++_name_cache_stats.hits;
+            return it->second;
+        }
+
+        ++_name_cache_stats.misses;
+    }
+
+    canonical_name canonical;
 
     // this works because names and servers can't have underscores in them, therefore if
     // there is no underscore in the string, we assume a local character name was passed
-    if (std::string::npos == name.find_last_of("_")) {
-        ret = GetServerShortName() + std::string("_") + ret;
+    const size_t pos = name.find_last_of("_");
+    if (std::string::npos == pos) {
+        canonical.full = init_string((server + std::string("_") + name).c_str());
+    } else {
+        canonical.full = init_string(name.c_str());
     }
 
-    return init_string(ret.c_str());
-}
+    // only our own server comes off, anyone else's stays in front so the name still says where they are
+    if (pos != std::string::npos && canonical.full.rfind(init_string((server + "_").c_str()), 0) == 0) {
+        canonical.short_name = init_string(name.substr(pos + 1).c_str());
+    } else {
+        canonical.short_name = init_string(name.c_str());
+    }
 
-MQ2DANNET_NODE_API const std::string MQ2DanNet::Node::get_short_name(const std::string& name) {
-    std::string ret = name;
-    size_t pos = name.find_last_of("_");
+    if (cached) {
+        if (_name_cache.size() >= name_cache_limit) {
+            ++_name_cache_stats.evictions;
+            _name_cache.clear();
+        }
 
-    if (pos != std::string::npos && name.find_first_of(GetServerShortName()) != std::string::npos) {
-        ret = name.substr(pos + 1);
+        _name_cache.emplace(name, canonical);
     }
 
-    return init_string(ret.c_str());
+    return canonical;
 }
 
 MQ2DANNET_NODE_API const std::string MQ2DanNet::Node::get_name(const std::string& name) {
@@ -940,13 +2903,13 @@ void Node::node_actor(zsock_t* pipe, void* args) {
         throw new std::invalid_argument("Could not create node");
     }
 
-    CHAR szBuf[MAX_STRING] = { 0 };
-    GetPrivateProfileString("General", "Interface", NULL, szBuf, MAX_STRING, INIFileName);
-    if (szBuf && szBuf[0] != '\0')
-        zyre_set_interface(node->_node, szBuf);
+    const std::string iface = node->_host.setting("General", "Interface");
+    if (!iface.empty())
+        zyre_set_interface(node->_node, iface.c_str());
 
     // send our node name for easier name recognition
     zyre_set_header(node->_node, "name", "%s", node->_node_name.c_str());
+    zyre_set_header(node->_node, "protocol", "%u", static_cast<unsigned int>(wire_version));
     zyre_start(node->_node);
     if (node->evasive() > 0)
         zyre_set_evasive_timeout(node->_node, node->evasive());
@@ -962,15 +2925,20 @@ void Node::node_actor(zsock_t* pipe, void* args) {
     std::set<std::string> groups = node->_rejoin_groups.copy();
     node->_rejoin_groups.clear();
 
+    node->update_membership([&groups](membership& current) -> void {
+        for (auto& group : groups) {
+            current.join_own(name_table::get().intern(group));
+        }
+    });
+
     for (auto group : groups) {
-        node->_own_groups.emplace(group);
         zyre_join(node->_node, group.c_str());
     }
 
     // TODO: This doesn't appear necessary, but experiment with it
     //zpoller_set_nonstop(poller, true);
 
-    DebugSpewAlways("Starting actor loop for %s : %s", node->_node_name.c_str(), zyre_uuid(node->_node));
+    node->debugf("Starting actor loop for %s : %s", node->_node_name.c_str(), zyre_uuid(node->_node));
 
     bool terminated = false;
     while (!terminated) {
@@ -986,210 +2954,129 @@ void Node::node_actor(zsock_t* pipe, void* args) {
             if (!msg)
                 continue; // Interrupted
 
-            // strings index commands because zeromq has the infrastructure and it's not time-critical
-            // otherwise, we'd have to deal with byte streams, which is totally unnecessary
-            char* command = zmsg_popstr(msg);
+            // commands are a single opcode byte so this is a jump table, names are only looked up for anything that
+            // didn't come from us ($TERM from zactor)
+            const auto start = std::chrono::steady_clock::now();
+            zframe_t* command_frame = zmsg_pop(msg);
+            const pipe_command command = pipe_command_from(command_frame);
+            if (command_frame && zframe_size(command_frame) != 1)
+                ++node->_pipe_stats.by_name;
 
-            //DebugSpewAlways("MQ2DanNet: command: %s", command);
+            //DebugSpewAlways("MQ2DanNet: command: %u", static_cast<unsigned int>(command));
 
-            // IMPORTANT: local commands are all caps, Remote commands will be passed to this as their class name
-            if (streq(command, "$TERM")) { // need to handle $TERM per zactor contract
+            switch (command) {
+            case pipe_command::Term: // need to handle $TERM per zactor contract
                 terminated = true;
-            } else if (streq(command, "JOIN")) {
+                break;
+            case pipe_command::Join: {
                 char* group = zmsg_popstr(msg);
                 if (group) {
-                    node->_own_groups.emplace(group);
+                    node->update_membership([group](membership& current) -> void {
+                        current.join_own(name_table::get().intern(group));
+                    });
                     zyre_join(node->_node, group);
                     zstr_free(&group);
                 }
-            } else if (streq(command, "LEAVE")) {
+                break;
+            }
+            case pipe_command::Leave: {
                 char* group = zmsg_popstr(msg);
                 if (group) {
-                    node->_own_groups.erase(group);
+                    node->update_membership([group](membership& current) -> void {
+                        current.leave_own(membership::id(group));
+                    });
                     zyre_leave(node->_node, group);
                     zstr_free(&group);
                 }
-            } else if (streq(command, "SHOUT")) {
+                break;
+            }
+            case pipe_command::Shout: {
                 char* group = zmsg_popstr(msg);
                 if (group) {
                     zyre_shout(node->_node, group, &msg);
+                    const auto current = node->snapshot();
+                    auto it = current->group_peers->find(membership::id(group));
+                    if (it != current->group_peers->end()) {
+                        for (auto& peer : *it->second) {
+                            node->sent(peer.str());
+                        }
+                    }
                     zstr_free(&group);
                 }
-            } else if (streq(command, "WHISPER")) {
+                break;
+            }
+            case pipe_command::Whisper: {
                 char* name = zmsg_popstr(msg);
                 if (name) {
+                    const auto lookup = std::chrono::steady_clock::now();
                     std::string uuid = node->peer_uuid(name);
-                    zstr_free(&name);
+                    node->_whisper_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - lookup).count();
                     if (!uuid.empty())
-                        zyre_whisper(node->_node, uuid.c_str(), &msg);
-                }
-            } else if (streq(command, "PEER")) {
-                char* name = zmsg_popstr(msg);
-                std::string uuid;
-                if (name) {
-                    uuid = node->peer_uuid(name);
-                    zstr_free(&name);
-                }
-
-                zstr_send(pipe, uuid.c_str());
-            } else if (streq(command, "PEERS")) {
-                zlist_t* peer_ids = zyre_peers(node->_node);
-                zmsg_t* peers = zmsg_new();
-                if (peer_ids) {
-                    const char* peer_id = reinterpret_cast<const char*>(zlist_first(peer_ids));
-                    while (peer_id) {
-                        char* name = zyre_peer_header_value(node->_node, peer_id, "name");
-                        if (name)
-                            zmsg_pushstr(peers, name);
-                        peer_id = reinterpret_cast<const char*>(zlist_next(peer_ids));
-                    }
-
-                    zlist_destroy(&peer_ids);
-                }
-
-                if (zmsg_size(peers) == 0)
-                    zmsg_pushstr(peers, "0");
-                zmsg_send(&peers, pipe);
-            } else if (streq(command, "PEER_GROUPS")) {
-                zlist_t* peer_groups = zyre_peer_groups(node->_node);
-                zmsg_t* groups = zmsg_new();
-                if (peer_groups) {
-                    const char* peer_group = reinterpret_cast<const char*>(zlist_first(peer_groups));
-                    while (peer_group) {
-                        zmsg_pushstr(groups, peer_group);
-                        peer_group = reinterpret_cast<const char*>(zlist_next(peer_groups));
-                    }
-
-                    zlist_destroy(&peer_groups);
-                }
-
-                if (zmsg_size(groups) == 0)
-                    zmsg_pushstr(groups, "");
-                zmsg_send(&groups, pipe);
-            } else if (streq(command, "OWN_GROUPS")) {
-                zlist_t* own_groups = zyre_own_groups(node->_node);
-                zmsg_t* groups = zmsg_new();
-                if (own_groups) {
-                    const char* peer_group = reinterpret_cast<const char*>(zlist_first(own_groups));
-                    while (peer_group) {
-                        zmsg_pushstr(groups, peer_group);
-                        peer_group = reinterpret_cast<const char*>(zlist_next(own_groups));
-                    }
-
-                    zlist_destroy(&own_groups);
-                }
-
-                if (zmsg_size(groups) == 0)
-                    zmsg_pushstr(groups, "");
-                zmsg_send(&groups, pipe);
-            } else if (streq(command, "PEERS_BY_GROUP")) {
-                char* group = zmsg_popstr(msg);
-                zmsg_t* peers = zmsg_new();
-                if (group) {
-                    zlist_t* peer_ids = zyre_peers_by_group(node->_node, group);
-                    if (peer_ids) {
-                        const char* peer_id = reinterpret_cast<const char*>(zlist_first(peer_ids));
-                        while (peer_id) {
-                            char* name = zyre_peer_header_value(node->_node, peer_id, "name");
-                            zmsg_pushstr(peers, name);
-                            peer_id = reinterpret_cast<const char*>(zlist_next(peer_ids));
-                        }
-
-                        zlist_destroy(&peer_ids);
-                    }
-                }
-
-                if (group)
-                    zstr_free(&group);
-                if (zmsg_size(peers) == 0)
-                    zmsg_pushstr(peers, "");
-                zmsg_send(&peers, pipe);
-            } else if (streq(command, "PEER_ADDRESS")) {
-                char* name = zmsg_popstr(msg);
-                zmsg_t* address = zmsg_new();
-
-                std::string uuid;
-                if (name) {
-                    uuid = node->peer_uuid(name);
+                        node->sent(node->get_full_name(name));
                     zstr_free(&name);
-                }
-
-                if (!uuid.empty()) {
-                    char* addr = zyre_peer_address(node->_node, uuid.c_str());
-                    if (addr) {
-                        zmsg_pushstr(address, addr);
-                        zstr_free(&addr);
+                    if (!uuid.empty()) {
+                        ++node->_whisper_stats.sent;
+                        zyre_whisper(node->_node, uuid.c_str(), &msg);
+                    } else {
+                        ++node->_whisper_stats.unroutable;
                     }
                 }
-
-                if (zmsg_size(address) == 0)
-                    zmsg_pushstr(address, "");
-                zmsg_send(&address, pipe);
-            } else if (streq(command, "EVASIVE")) {
+                break;
+            }
+            case pipe_command::Evasive: {
                 char* szEvasive = zmsg_popstr(msg);
-                if (IsNumber(szEvasive)) {
+                if (is_number(szEvasive)) {
                     zyre_set_evasive_timeout(node->_node, node->evasive());
                 } else if (szEvasive) {
-                    DebugSpewAlways("EVASIVE: Trying to set non-numeric %s.", szEvasive);
+                    node->debugf("EVASIVE: Trying to set non-numeric %s.", szEvasive);
                 } else {
-                    DebugSpewAlways("EVASIVE: Trying to set null.");
+                    node->debugf("EVASIVE: Trying to set null.");
                 }
-            } else if (streq(command, "EXPIRED")) {
+                break;
+            }
+            case pipe_command::Expired: {
                 char* szExpired = zmsg_popstr(msg);
-                if (IsNumber(szExpired)) {
+                if (is_number(szExpired)) {
                     zyre_set_expired_timeout(node->_node, node->expired());
                 } else if (szExpired) {
-                    DebugSpewAlways("EXPIRED: Trying to set non-numeric %s.", szExpired);
+                    node->debugf("EXPIRED: Trying to set non-numeric %s.", szExpired);
                 } else {
-                    DebugSpewAlways("EXPIRED: Trying to set null.");
+                    node->debugf("EXPIRED: Trying to set null.");
                 }
-            } else if (streq(command, "KEEPALIVE")) {
+                break;
+            }
+            case pipe_command::Keepalive: {
                 char* szKeepalive = zmsg_popstr(msg);
-                if (IsNumber(szKeepalive)) {
-                    zyre_set_expired_timeout(node->_node, GetIntFromString(szKeepalive, 0));
+                if (is_number(szKeepalive)) {
+                    zyre_set_expired_timeout(node->_node, std::atoi(szKeepalive));
                 } else if (szKeepalive) {
-                    DebugSpewAlways("KEEPALIVE: Trying to set non-numeric %s.", szKeepalive);
+                    node->debugf("KEEPALIVE: Trying to set non-numeric %s.", szKeepalive);
                 } else {
-                    DebugSpewAlways("KEEPALIVE: Trying to set null.");
+                    node->debugf("KEEPALIVE: Trying to set null.");
                 }
 
                 if (szKeepalive)
                     zstr_free(&szKeepalive);
-            } else if (streq(command, "PING")) {
+                break;
+            }
+            case pipe_command::Ping:
                 zstr_send(pipe, "PONG");
-            } else if (streq(command, "PONG")) {
-				// TODO: we can potentially track keepalive responses, but for now let's just discard this
-            } else {
-                zframe_t* body = zmsg_pop(msg);
-                char* name = zmsg_popstr(msg);
-                char* group = zmsg_popstr(msg);
-
-                if (body) {
-                    std::stringstream args;
-                    Archive<std::stringstream> args_ar(args);
-                    args_ar << std::string(name ? name : "") << std::string(group ? group : "");
-                    char* body_data = (char*)zframe_data(body);
-                    size_t body_size = zframe_size(body);
-
-                    args.write(body_data, body_size);
-
-                    node->queue_command(command, std::move(args));
-                } else {
-                    DebugSpewAlways("MQ2DanNet: Empty %s message in pipe handler: group %s, name %s, body %s.", command, group, name, body);
-                }
-
-                if (group)
-                    zstr_free(&group);
-                if (name)
-                    zstr_free(&name);
-                if (body)
-                    zframe_destroy(&body);
+                break;
+            case pipe_command::Pong:
+                // PING/PONG only keeps the pipe to the actor alive, round trips to peers are timed by Probe
+                break;
+            default:
+                node->debugf("MQ2DanNet: Got unhandled %u command in pipe handler.", static_cast<unsigned int>(command));
+                break;
             }
 
-            if (command)
-                zstr_free(&command);
+            if (command_frame)
+                zframe_destroy(&command_frame);
             if (msg)
                 zmsg_destroy(&msg);
+
+            ++node->_pipe_stats.commands;
+            node->_pipe_stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
         } else if (which == zyre_socket(node->_node)) {
             // we've received something over our socket
             //DebugSpewAlways("Got a message over the socket");
@@ -1202,47 +3089,57 @@ void Node::node_actor(zsock_t* pipe, void* args) {
             std::string name = init_string(zyre_event_peer_name(z_event));
 
             if (event_type.empty()) {
-                DebugSpewAlways("MQ2DanNet: Got zyre message with empty event type!");
+                node->debugf("MQ2DanNet: Got zyre message with empty event type!");
             } else if (name.empty()) {
-                DebugSpewAlways("MQ2DanNet: Got %s message with empty name!", event_type.c_str());
+                node->debugf("MQ2DanNet: Got %s message with empty name!", event_type.c_str());
             } else if (event_type == "ENTER") {
                 // TODO: can possibly do something with headers here (`zyre_event_headers(z_event)`)
-                // can also harvest the IP:port if we need it
                 std::string uuid = init_string(zyre_event_peer_uuid(z_event));
                 if (uuid.empty()) {
-                    DebugSpewAlways("MQ2DanNet: ENTER with empty UUID for name %s, will not add to peers list.", name.c_str());
+                    node->debugf("MQ2DanNet: ENTER with empty UUID for name %s, will not add to peers list.", name.c_str());
                 } else {
-                    node->_connected_peers.upsert(name, uuid);
+                    // zyre keys its peers on the uuid exactly as it gave it to us, so don't use the lowercased one here
+                    node->_peer_uuids[name] = zyre_event_peer_uuid(z_event);
+
+                    // peers that predate the protocol header are v1
+                    const char* protocol = zyre_event_header(z_event, "protocol");
+                    const int version = protocol ? std::min(is_number(protocol) ? std::atoi(protocol) : static_cast<int>(wire_v1), static_cast<int>(wire_version)) : wire_v1;
+
+                    node->seen(name);
+
+                    const char* address = zyre_event_peer_addr(z_event);
+                    const name_ref peer = name_table::get().intern(name);
+                    node->update_membership([&peer, &uuid, address, version](membership& current) -> void {
+                        current.add_peer(peer, uuid);
+                        current.addresses.edit()[peer] = address ? address : "";
+                        if (version > wire_v1)
+                            current.protocols.edit()[peer] = static_cast<unsigned char>(version);
+                        else if (current.protocols->count(peer))
+                            current.protocols.edit().erase(peer);
+                    });
                 }
                 //DebugSpewAlways("%s is ENTERing.", name.c_str());
             } else if (event_type == "EXIT") {
-                node->_connected_peers.erase(name);
-
-                std::map<std::string, std::set<std::string>> new_groups;
-                node->_peer_groups.foreach ([&name, &new_groups](std::pair<std::string, std::set<std::string>> group) -> void {
-                    std::set<std::string> new_set = group.second;
-                    if (new_set.erase(name) > 0) {
-                        new_groups[group.first] = new_set;
-                    }
+                node->_peer_uuids.erase(name);
+                node->_peer_health.erase(name);
+                node->update_membership([&name](membership& current) -> void {
+                    current.remove_peer(membership::id(name));
                 });
 
-                for (auto it = new_groups.begin(); it != new_groups.end(); ++it) {
-                    node->_peer_groups.upsert(it->first, it->second);
-                }
-
                 //DebugSpewAlways("%s is EXITing.", name.c_str());
             } else if (event_type == "JOIN") {
                 std::string group = init_string(zyre_event_group(z_event));
 
                 if (group.empty()) {
-                    DebugSpewAlways("MQ2DanNet: JOIN with empty group with name %s, will not add to lists.", name.c_str());
+                    node->debugf("MQ2DanNet: JOIN with empty group with name %s, will not add to lists.", name.c_str());
                 } else {
                     node->_join_callbacks.remove_if([&name, &group](std::function<bool(const std::string&, const std::string&)> f) -> bool {
                         return f(name, group);
                     });
 
-                    node->_peer_groups.upsert(group, [&name](std::set<std::string>& group) -> void {
-                        group.emplace(name);
+                    node->seen(name);
+                    node->update_membership([&name, &group](membership& current) -> void {
+                        current.join(name_table::get().intern(group), name_table::get().intern(name));
                     });
                     //DebugSpewAlways("JOIN %s : %s", group.c_str(), name.c_str());
                 }
@@ -1250,66 +3147,74 @@ void Node::node_actor(zsock_t* pipe, void* args) {
                 std::string group = init_string(zyre_event_group(z_event));
 
                 if (group.empty()) {
-                    DebugSpewAlways("MQ2DanNet: LEAVE with empty group with name %s, will not remove from lists.", name.c_str());
+                    node->debugf("MQ2DanNet: LEAVE with empty group with name %s, will not remove from lists.", name.c_str());
                 } else {
                     node->_leave_callbacks.remove_if([&name, &group](std::function<bool(const std::string&, const std::string&)> f) -> bool {
                         return f(name, group);
                     });
-                    node->_peer_groups.erase_if(group, [&name](std::set<std::string>& group) -> bool {
-                        group.erase(name);
-                        return group.empty();
+                    node->update_membership([&name, &group](membership& current) -> void {
+                        current.leave(membership::id(group), membership::id(name));
                     });
                     //DebugSpewAlways("LEAVE %s : %s", group.c_str(), name.c_str());
                 }
             } else if (event_type == "WHISPER") {
-                // use get_msg because we want ownership to pass the command up
+                // use get_msg because we want ownership of the body to pass the command up
                 zmsg_t* message = zyre_event_get_msg(z_event);
                 if (!message) {
-                    DebugSpewAlways("MQ2DanNet: Got NULL WHISPER message from %s", name.c_str());
+                    node->debugf("MQ2DanNet: Got NULL WHISPER message from %s", name.c_str());
                 } else {
-                    zmsg_addstr(message, name.c_str());
-                    zmsg_send(&message, node->_actor);
+                    node->seen(name, 1);
+                    if (!node->receive(message, name, std::string()))
+                        node->debugf("MQ2DanNet: Got malformed WHISPER message from %s", name.c_str());
+                    zmsg_destroy(&message);
                 }
             } else if (event_type == "SHOUT") {
                 // this presumes that group will return NULL if not a shot, which is valid in zyre if we don't set ZYRE_DEBUG or ZYRE_PEDANTIC
                 std::string group = init_string(zyre_event_group(z_event));
 
                 if (group.empty()) {
-                    DebugSpewAlways("MQ2DanNet: SHOUT with empty group from %s, not passing message.", name.c_str());
+                    node->debugf("MQ2DanNet: SHOUT with empty group from %s, not passing message.", name.c_str());
                 } else {
-                    // use get_msg because we want ownership to pass the command up
+                    // use get_msg because we want ownership of the body to pass the command up
                     zmsg_t* message = zyre_event_get_msg(z_event);
                     if (!message) {
-                        DebugSpewAlways("MQ2DanNet: Got NULL SHOUT message from %s in %s", name.c_str(), group.c_str());
+                        node->debugf("MQ2DanNet: Got NULL SHOUT message from %s in %s", name.c_str(), group.c_str());
                     } else {
-                        // note that this goes to the end of the message
-                        zmsg_addstr(message, name.c_str());
-                        zmsg_addstr(message, group.c_str());
-                        zmsg_send(&message, node->_actor);
+                        node->seen(name, 1);
+                        if (!node->receive(message, name, group))
+                            node->debugf("MQ2DanNet: Got malformed SHOUT message from %s in %s", name.c_str(), group.c_str());
+                        zmsg_destroy(&message);
                     }
                 }
             } else if (event_type == "EVASIVE" || event_type == "SILENT") {
-                // not sure if anything needs to be done here?
-                // also, turns out this is done a lot so let's just mute it to reduce spam
-                //TODO: need to maintain a keepalive list so we can remove peers that have disconnected (how to force remove peers? it might be a command to the actor, look this up.)
-                auto tick = MQGetTickCount64();
+                // turns out this is done a lot, so it only gets counted (see /dnet peers) and spewed. zyre can still
+                // report a peer after its EXIT, so don't bring its entry back
+                const bool evasive = event_type == "EVASIVE";
+                node->_peer_health.update(name, [evasive](peer_health& health) -> void {
+                    if (evasive)
+                        ++health.evasive;
+                    else
+                        ++health.silent;
+                });
+
+                auto tick = node->_host.tick();
                 //zlist_t *peer_ids = zyre_peers(node->_node);
                 //if (peer_ids) {
                 //    const char *peer_id = reinterpret_cast<const char*>(zlist_first(peer_ids));
                 //    while (peer_id) {
                 //        char *peer = zyre_peer_header_value(node->_node, peer_id, "name");
                 //        if (peer)
-                //            DebugSpewAlways("PEER: %s", peer);
+                //            node->debugf("PEER: %s", peer);
                 //        peer_id = reinterpret_cast<const char*>(zlist_next(peer_ids));
                 //    }
 
                 //    zlist_destroy(&peer_ids);
                 //}
 
-                DebugSpewAlways("%s is being %s at %ull", name.c_str(), event_type.c_str(), tick);
+                node->debugf("%s is being %s at %ull", name.c_str(), event_type.c_str(), tick);
                 if (node->_evasive_refresh) node->whisper<Reupdate>(name);
             } else {
-                DebugSpewAlways("MQ2DanNet: Got unhandled event type %s.", event_type.c_str());
+                node->debugf("MQ2DanNet: Got unhandled event type %s.", event_type.c_str());
             }
 
             zyre_event_destroy(&z_event);
@@ -1328,7 +3233,11 @@ void Node::node_actor(zsock_t* pipe, void* args) {
 
         zlist_destroy(&own_groups);
     }
-    node->_own_groups.clear();
+    node->update_membership([](membership& current) -> void {
+        current.clear_own();
+    });
+    node->_peer_uuids.clear();
+    node->_peer_health.clear();
 
     zyre_stop(node->_node);
     zclock_sleep(100);
@@ -1348,7 +3257,19 @@ std::string Node::init_string(const char* szStr) {
     return std::string();
 }
 
-MQ2DANNET_NODE_API std::string MQ2DanNet::Node::register_response(std::function<bool(std::stringstream&&)> callback) {
+bool Node::is_number(const char* szStr) {
+    if (!szStr || !*szStr)
+        return false;
+
+    for (const char* c = szStr; *c; ++c) {
+        if (*c < '0' || *c > '9')
+            return false;
+    }
+
+    return true;
+}
+
+MQ2DANNET_NODE_API std::string MQ2DanNet::Node::register_response(std::function<bool(const message&)> callback) {
     // C99, 6.2.5p9 -- guarantees that this will wrap to 0 once we reach max value
     unsigned char next_val = _response_keys.get_next([](unsigned char key) -> unsigned char {
         return key + 1;
@@ -1363,75 +3284,166 @@ MQ2DANNET_NODE_API std::string MQ2DanNet::Node::register_response(std::function<
 // this is pretty much fire and forget. We could potentially have a bunch of vacant observers, but don't worry about that, let's just test it.
 // if we have to start dropping observer groups, then we need to figure out a way to gracefully handle desyncs
 // potentially on_join if no group is available, have the client re-register?
-MQ2DANNET_NODE_API std::string MQ2DanNet::Node::register_observer(const std::string& name, const std::string& query) {
-    // first search for the key in the map already
-    for (auto observer : _observer_map.copy()) {
-        if (observer.second.query == query)
-            return observer_group(observer.first);
+MQ2DANNET_NODE_API std::string MQ2DanNet::Node::register_observer(const std::string& name, const std::string& query, unsigned int rate, unsigned int heartbeat) {
+    // first search for the key in the index already
+    auto it = _observer_keys.find(query);
+    if (it != _observer_keys.end()) {
+        const unsigned int key = it->second;
+        Query& observer = _observer_map[key];
+
+        // asking again replaces what name asked for before
+        observe_request& request = observer.requests[name];
+        request.rate = rate;
+        request.heartbeat = heartbeat;
+
+        const unsigned int previous_rate = observer.rate;
+        refresh_requests(key, observer);
+        if (observer.rate != previous_rate)
+            _observer_schedule_stale = true; // its due was worked out with the old rate
+
+        return observer_group(key);
     }
 
     // didn't find anything, insert a new one
     Query obs(query);
+    obs.requests[name] = observe_request{ rate, heartbeat };
 
-    unsigned int position = _observer_map.upsert_wrap(std::move(obs), [](unsigned int p) -> unsigned int {
-        return p + 1;
-    });
+    // one past the highest key, this wraps to 0 once we reach max value (C99, 6.2.5p9)
+    const unsigned int position = _observer_map.empty() ? 0 : _observer_map.crbegin()->first + 1;
+    refresh_requests(position, obs);
+    _observer_map[position] = std::move(obs);
+    _observer_keys[query] = position;
+
+    // due straight away
+    _observer_schedule.push(scheduled_observer{ 0, position });
 
     return observer_group(position);
 }
 
+void Node::refresh_requests(unsigned int key, Query& observer) {
+    refresh_requests(observer_group(key), observer, *snapshot());
+}
+
+void Node::refresh_requests(const std::string& group, Query& observer, const membership& current) {
+    // anyone who was in the group and isn't anymore has stopped observing. Anyone who hasn't shown up yet may just not
+    // have joined, so they count until they have
+    unsigned int rate = 0;
+    unsigned int heartbeat = 0;
+    for (auto it = observer.requests.begin(); it != observer.requests.end();) {
+        const bool member = current.is_member(group, it->first);
+        if (!member && it->second.joined) {
+            it = observer.requests.erase(it);
+            continue;
+        }
+
+        it->second.joined = member;
+
+        // 0 is whatever our delay is, so it has to be resolved before it can be compared
+        const unsigned int requested = it->second.rate ? it->second.rate : observe_delay();
+        rate = rate ? std::min(rate, requested) : requested;
+        if (it->second.heartbeat)
+            heartbeat = heartbeat ? std::min(heartbeat, it->second.heartbeat) : it->second.heartbeat;
+        ++it;
+    }
+
+    observer.rate = rate;
+    observer.heartbeat = heartbeat;
+    observer.refreshed = current.generation;
+}
+
 MQ2DANNET_NODE_API void MQ2DanNet::Node::unregister_observer(const std::string& query) {
-    _observer_map.erase_if([&query](std::pair<unsigned int, Query> p) -> bool {
-        return p.second.query == query;
-    });
+    auto it = _observer_keys.find(query);
+    if (it == _observer_keys.end())
+        return;
+
+    _observer_map.erase(it->second);
+    _observer_keys.erase(it);
+
+    // its entry would just be skipped, but don't let them pile up if observers come and go
+    if (_observer_schedule.size() > 2 * _observer_keys.size() + 16)
+        _observer_schedule_stale = true;
 }
 
 MQ2DANNET_NODE_API void MQ2DanNet::Node::observe(const std::string& group, const std::string& name, const std::string& query) {
     join(group);
-    _observed_map.upsert(Observed(query, name), group);
+    const name_ref group_id = name_table::get().intern(group);
+    const Observed observed = Observed::intern(query, name);
+
+    // asking again (for another rate, say) hands back the same group, and what came through Updates for it still holds
+    if (_observed_map.get(observed) != group_id)
+        _observed_sequences.erase(group_id);
+    _observed_map.upsert(observed, group_id);
+}
+
+MQ2DANNET_NODE_API void MQ2DanNet::Node::observe_requested(const std::string& name, const std::string& query, unsigned int rate, unsigned int heartbeat) {
+    _observe_rates[std::make_pair(name, query)] = std::make_pair(rate, heartbeat);
+}
+
+MQ2DANNET_NODE_API bool MQ2DanNet::Node::observing_at(const std::string& name, const std::string& query, unsigned int rate, unsigned int heartbeat) {
+    auto it = _observe_rates.find(std::make_pair(name, trim_query(query)));
+    return it != _observe_rates.end() && it->second == std::make_pair(rate, heartbeat);
 }
 
 MQ2DANNET_NODE_API void MQ2DanNet::Node::forget(const std::string& group) {
-    _observed_map.erase_if([&group](auto p) -> bool {
-        return p.second == group;
-    });
+    const name_ref group_id = name_table::get().find(group);
+    if (group_id) {
+        _observed_map.erase_if([this, &group_id](auto p) -> bool {
+            if (p.second != group_id)
+                return false;
+
+            _observe_rates.erase(std::make_pair(p.first.name.str(), p.first.query.str()));
+            return true;
+        });
 
-    _observed_data.erase(group);
+        _observed_data.erase(group_id);
+        _observed_sequences.erase(group_id);
+    }
 
     leave(group);
 }
 
 MQ2DANNET_NODE_API void MQ2DanNet::Node::forget(const std::string& name, const std::string& query) {
-    Observed observed = Observed(query, name);
-    _observed_map.foreach ([this, observed](std::pair<Observed, std::string> pair) -> void {
+    Observed observed = Observed::find(query, name);
+    if (!observed.query || !observed.name)
+        return;
+
+    _observed_map.foreach ([this, &observed](const std::pair<const Observed, name_ref>& pair) -> void {
         if (pair.first.query == observed.query && pair.first.name == observed.name) {
             _observed_data.erase(pair.second);
-            leave(pair.second);
+            _observed_sequences.erase(pair.second);
+            leave(pair.second.str());
         }
     });
     _observed_map.erase(observed);
+    _observe_rates.erase(std::make_pair(name, trim_query(query)));
 }
 
 MQ2DANNET_NODE_API void MQ2DanNet::Node::forget_all(const std::string& name) {
+    const name_ref peer = name_table::get().find(name);
+    if (!peer)
+        return;
+
     std::list<Observed> to_drop;
-    _observed_map.foreach ([this, &name, &to_drop](std::pair<Observed, std::string> pair) -> void {
-        if (pair.first.name == name) {
+    _observed_map.foreach ([this, &peer, &to_drop](const std::pair<const Observed, name_ref>& pair) -> void {
+        if (pair.first.name == peer) {
             _observed_data.erase(pair.second);
-            leave(pair.second);
+            _observed_sequences.erase(pair.second);
+            leave(pair.second.str());
             to_drop.push_back(pair.first);
         }
     });
 
-    for (auto drop : to_drop) {
+    for (auto& drop : to_drop) {
         _observed_map.erase(drop);
+        _observe_rates.erase(std::make_pair(name, drop.query.str()));
     }
 }
 
 MQ2DANNET_NODE_API void MQ2DanNet::Node::forget_if(bool (*predicate)(const Observation& observation)) {
     std::list<std::string> to_drop; // list of group names to drop
-    _observed_data.foreach ([this, &predicate, &to_drop](std::pair<std::string, Observation> pair) -> void {
-        if (predicate(pair.second)) {
-            to_drop.push_back(pair.first);
+    _observed_data.foreach ([this, &predicate, &to_drop](const std::pair<const name_ref, std::shared_ptr<const Observation>>& pair) -> void {
+        if (pair.second && predicate(*pair.second)) {
+            to_drop.push_back(pair.first.str());
         }
     });
 
@@ -1440,91 +3452,117 @@ MQ2DANNET_NODE_API void MQ2DanNet::Node::forget_if(bool (*predicate)(const Obser
     }
 }
 
-MQ2DANNET_NODE_API void MQ2DanNet::Node::update(const std::string& group, const std::string& data, const std::string& output) {
-    _observed_data.upsert(group, Observation(output, data, MQGetTickCount64()));
+MQ2DANNET_NODE_API void MQ2DanNet::Node::update(const std::string& group, observed_value data, const std::string& output) {
+    _observed_data.upsert(name_table::get().intern(group), std::make_shared<const Observation>(output, std::move(data), _host.tick()));
+}
+
+MQ2DANNET_NODE_API std::shared_ptr<const Node::Observation> MQ2DanNet::Node::read(const std::string& group) {
+    return read(name_table::get().find(group));
 }
 
-MQ2DANNET_NODE_API const Node::Observation MQ2DanNet::Node::read(const std::string& group) {
-    return _observed_data.get(group);
+std::shared_ptr<const Node::Observation> MQ2DanNet::Node::read(const name_ref& group) {
+    static const std::shared_ptr<const Observation> empty = std::make_shared<const Observation>();
+
+    std::shared_ptr<const Observation> observation = _observed_data.get(group);
+    return observation ? observation : empty;
 }
 
-MQ2DANNET_NODE_API const Node::Observation MQ2DanNet::Node::read(const std::string& name, const std::string& query) {
-    // this is safe because these get return default constructed objects if they aren't found
-    return _observed_data.get(_observed_map.get(Observed(query, name)));
+MQ2DANNET_NODE_API std::shared_ptr<const Node::Observation> MQ2DanNet::Node::read(const std::string& name, const std::string& query) {
+    // this is safe because get returns a default constructed object if it isn't found (and 0 is never a group)
+    return read(_observed_map.get(Observed::find(query, name)));
 }
 
 MQ2DANNET_NODE_API bool MQ2DanNet::Node::can_read(const std::string& name, const std::string& query) {
-    return _observed_map.contains(Observed(query, name));
+    return _observed_map.contains(Observed::find(query, name));
 }
 
 MQ2DANNET_NODE_API size_t MQ2DanNet::Node::observed_count(const std::string& name) {
-    std::set<Observed, ObservedCompare> keys = _observed_map.keys();
-    std::list<Observed> observed;
-    std::copy_if(keys.cbegin(), keys.cend(), std::inserter(observed, observed.begin()),
-        [&name](const Observed& obs) { return obs.name == name; });
+    const name_ref peer = name_table::get().find(name);
+    if (!peer)
+        return 0;
 
-    return observed.size();
+    std::set<Observed, ObservedCompare> keys = _observed_map.keys();
+    return static_cast<size_t>(std::count_if(keys.cbegin(), keys.cend(),
+        [&peer](const Observed& obs) { return obs.name == peer; }));
 }
 
 MQ2DANNET_NODE_API std::set<std::string> MQ2DanNet::Node::observed_queries(const std::string& name) {
-    std::set<Observed, ObservedCompare> keys = _observed_map.keys();
-    std::set<Observed, ObservedCompare> observed;
-    std::copy_if(keys.cbegin(), keys.cend(), std::inserter(observed, observed.begin()),
-        [&name](const Observed& obs) { return obs.name == name; });
-
     std::set<std::string> queries;
-    std::transform(observed.cbegin(), observed.cend(), std::inserter(queries, queries.begin()),
-        [](const Observed& obs) { return obs.query; });
+    const name_ref peer = name_table::get().find(name);
+    if (!peer)
+        return queries;
+
+    for (const Observed& obs : _observed_map.keys()) {
+        if (obs.name == peer)
+            queries.insert(obs.query.str());
+    }
 
     return queries;
 }
 
 MQ2DANNET_NODE_API size_t MQ2DanNet::Node::observer_count() {
-    return _observer_map.keys().size();
+    return _observer_keys.size();
 }
 
 MQ2DANNET_NODE_API std::set<std::string> MQ2DanNet::Node::observer_queries() {
-    std::list<Query> values = _observer_map.values();
     std::set<std::string> queries;
-    std::transform(values.cbegin(), values.cend(), std::inserter(queries, queries.begin()),
-        [](const Query& query) { return query.query; });
+    std::transform(_observer_keys.cbegin(), _observer_keys.cend(), std::inserter(queries, queries.begin()),
+        [](const std::pair<const std::string, unsigned int>& observer) { return observer.first; });
 
     return queries;
 }
 
 MQ2DANNET_NODE_API std::set<std::string> MQ2DanNet::Node::observers(const std::string& query) {
-    for (auto observer : _observer_map.copy()) {
-        if (observer.second.query == query) {
-            return get_group_peers(Node::get().observer_group(observer.first));
-        }
-    }
+    auto it = _observer_keys.find(query);
+    if (it != _observer_keys.end())
+        return get_group_peers(observer_group(it->second));
 
     return std::set<std::string>();
 }
 
 // stub these for now, nothing to do here since memory is managed elsewhere (and all registered commands will go away)
-Node::Node() = default;
+Node::Node(host& client) : _host(client) {}
 Node::~Node() = default;
 
-Node::Observation MQ2DanNet::Node::query(const std::string& name, const std::string& query){
+std::shared_ptr<const Node::Observation> MQ2DanNet::Node::query(const std::string& name, const std::string& query){
+    static const std::shared_ptr<const Observation> empty = std::make_shared<const Observation>();
+
     // loop through results and find the entry where peer name and query matches
     std::string final_query = trim_query(query);
     std::string final_name = get_full_name(name);
-    return _query_result_map.get(Observed(final_name, final_query));
+    std::shared_ptr<const Observation> observation = _query_result_map.get(Observed::find(final_query, final_name));
+    return observation ? observation : empty;
 }
 
-Node::Observation MQ2DanNet::Node::query() {
+std::shared_ptr<const Node::Observation> MQ2DanNet::Node::query() {
     // this function is purely for backwards compat with the previous macro-centric design
     return _query_result;
 }
 
 void MQ2DanNet::Node::query_result(const std::string& name, const std::string& query, const Observation& obs) {
-    _query_result = obs; // store the latest result for easy compat with macros
+    // store the latest result for easy compat with macros
+    _query_result = std::make_shared<const Observation>(obs);
 
     // upsert a query from a peer
     std::string final_query = trim_query(query);
     std::string final_name = get_full_name(name);
-    _query_result_map.upsert(Observed(final_name, final_query), obs);
+    _query_result_map.upsert(Observed::intern(final_query, final_name), _query_result);
+
+    // every query ever asked of every peer would stay in here (and its text in the name table) otherwise. Anything still
+    // waiting on its answer is kept
+    if (_query_result_map.size() > query_result_limit) {
+        Observed oldest;
+        unsigned __int64 received = 0;
+        _query_result_map.foreach ([&oldest, &received](const std::pair<const Observed, std::shared_ptr<const Observation>>& pair) -> void {
+            if (pair.second->received && (!received || pair.second->received < received)) {
+                oldest = pair.first;
+                received = pair.second->received;
+            }
+        });
+
+        if (received)
+            _query_result_map.erase(oldest);
+    }
 }
 
 std::string MQ2DanNet::Node::trim_query(const std::string& query) {
@@ -1546,54 +3584,36 @@ std::string MQ2DanNet::Node::trim_query(const std::string& query) {
 }
 
 std::string MQ2DanNet::Node::parse_query(const std::string& query) {
-    CHAR szQuery[MAX_STRING];
-    strcpy_s(szQuery, ("${" + query + "}").c_str());
-
-    ParseMacroData(szQuery, MAX_STRING);
-    return szQuery;
+    return _host.evaluate("${" + query + "}");
 }
 
-MQTypeVar MQ2DanNet::Node::parse_response(const std::string& output, const std::string& data) {
+Node::stored_response MQ2DanNet::Node::parse_response(const std::string& output, const std::string& data) {
     // we need to pass a string data into here because we need to make sure that the output type can handle
     // the data we give it, which is handled in `FromString`, and if we aren't in a macro we are just going
     // to write it out anyway.
+    stored_response result;
 
-    if (!output.empty() && gMacroBlock) { // let's make sure a macro is running here
-        CHAR szOutput[MAX_STRING] = { 0 };
-        strcpy_s(szOutput, output.c_str());
-        MQDataVar* pVar = FindMQ2DataVariable(szOutput);
-        if (pVar) {
-            CHAR szData[MAX_STRING] = { 0 };
-            strcpy_s(szData, data.c_str());
-            if (!pVar->Var.Type->FromString(pVar->Var.VarPtr, szData)) {
-                MacroError("/dquery: setting '%s' failed, variable type rejected new value of %s", szOutput, szData);
-            }
-
-            if (pVar)
-                return pVar->Var;
-        } else {
-            MacroError("/dquery failed, variable '%s' not found", szOutput);
+    if (!output.empty() && _host.in_macro()) { // let's make sure a macro is running here
+        if (!_host.store(output, data, result.type, result.value)) {
+            _host.macro_error("/dquery failed, variable '" + output + "' not found");
+            result.type.clear();
+            result.value = "NULL";
         }
     } else {
         // if we aren't in a macro or we have no output, we are dealing with a string
-        MQTypeVar Result;
-        strcpy_s(DataTypeTemp, data.c_str());
-        Result.Ptr = &DataTypeTemp[0];
-        Result.Type = mq::datatypes::pStringType;
+        result.type = "string";
+        result.value = data;
         if (debugging())
-            WriteChatf("%s", data.c_str());
-
-        return Result;
+            _host.write_chat(data);
     }
 
-    MQTypeVar Result;
-    Result.Type = 0;
-    Result.Int64 = 0;
-    return Result;
+    return result;
 }
 
 std::string MQ2DanNet::Node::peer_address(const std::string& name) {
-    return _connected_peers.get(name);
+    const auto current = snapshot();
+    auto it = current->addresses->find(membership::id(get_full_name(name)));
+    return it != current->addresses->end() ? it->second : std::string();
 }
 
 void MQ2DanNet::Node::save_channels() {
@@ -1607,19 +3627,29 @@ void MQ2DanNet::Node::clear_saved_channels() {
 }
 
 void Node::enter() {
-    PCHARINFO pChar = GetCharInfo();
-    if (!pChar)
+    const std::string character = _host.character_name();
+    if (character.empty())
         return;
 
-	if (IsMainThread()) {
+    if (_host.on_main_thread()) {
         if (_actor) {
-            DebugSpewAlways("Already had actor for %s", _node_name.c_str());
+            debugf("Already had actor for %s", _node_name.c_str());
             zactor_destroy(&_actor);
         }
 
-        _node_name = get_full_name(pChar->Name);
+        // the actor isn't running here, so nothing else can be reading these
+        const std::string server = _host.server_name();
+        if (server != _server_name) {
+            if (!_name_cache.empty())
+                ++_name_cache_stats.invalidations;
+            _name_cache.clear();
+            _server_name = server;
+        }
+        _game_thread = std::this_thread::get_id();
+
+        _node_name = get_full_name(character);
 
-        DebugSpewAlways("Spinning up actor for %s", _node_name.c_str());
+        debugf("Spinning up actor for %s", _node_name.c_str());
         _actor = zactor_new(Node::node_actor, this);
 
         if (_actor) {
@@ -1632,59 +3662,59 @@ void Node::enter() {
                 throw new std::invalid_argument("Could not create poller");
         }
     } else {
-        PostToMainThread([this]() { this->enter(); });
-	}
+        _host.post([this]() { this->enter(); });
+    }
 }
 
 void Node::exit() {
-    if (IsMainThread()) {
+    if (_host.on_main_thread()) {
         if (_actor) {
-            DebugSpewAlways("Destroying actor for %s", _node_name.c_str());
+            debugf("Destroying actor for %s", _node_name.c_str());
             zactor_destroy(&_actor);
         } else if (_node || _poller) {
             // in general destroying the zactor will do this, but just in case it's dangling, let's be safe
             // it's possible that the actor is in the process of destruction, so let's make sure the lock
             // has been released before attempting to destroy the constituents
             if (_node) {
-                DebugSpewAlways("WARNING: had a node without an actor in %s", _node_name.c_str());
+                debugf("WARNING: had a node without an actor in %s", _node_name.c_str());
                 zyre_destroy(&_node);
             }
 
             if (_poller) {
-                DebugSpewAlways("WARNING: had a poller without an actor in %s", _node_name.c_str());
+                debugf("WARNING: had a poller without an actor in %s", _node_name.c_str());
                 zpoller_destroy(&_poller);
             }
         }
 
         _node_name = "";
 	} else {
-        PostToMainThread([this]() { this->exit(); });
+        _host.post([this]() { this->exit(); });
 	}
 }
 
 void MQ2DanNet::Node::startup() {
-    if (IsMainThread()) {
+    if (_host.on_main_thread()) {
         // ensure that startup has happened so that we can put our atexit at the proper place in the exit function queue
         zsys_init();
         //atexit([]() -> void {});
     } else {
-        PostToMainThread([this]() { this->startup(); });
+        _host.post([this]() { this->startup(); });
 	}
 }
 
 void MQ2DanNet::Node::set_timeout(int timeout) {
-    if (IsMainThread()) {
+    if (_host.on_main_thread()) {
         zmq_setsockopt(_actor, ZMQ_RCVTIMEO, "", timeout);
     } else {
-        PostToMainThread([this, timeout]() { this->set_timeout(timeout); });
+        _host.post([this, timeout]() { this->set_timeout(timeout); });
 	}
 }
 
 void MQ2DanNet::Node::shutdown() {
-    if (IsMainThread()) {
+    if (_host.on_main_thread()) {
         zsys_shutdown();
     } else {
-        PostToMainThread([this]() { this->shutdown(); });
+        _host.post([this]() { this->shutdown(); });
 	}
 }
 
@@ -1700,8 +3730,7 @@ void MQ2DanNet::Node::recv() {
             char* command = zmsg_popstr(msg);
             if (command) {
                 if (streq(command, "PING"))
-                    zstr_send(_actor, "PONG");
-				// TODO: can potentially handle PONG here like in the actor thread, but for now let's discard it
+                    send_pipe_command(_actor, pipe_command::Pong);
                 zstr_free(&command);
             }
             zmsg_destroy(&msg);
@@ -1709,361 +3738,735 @@ void MQ2DanNet::Node::recv() {
     }
 }
 
-void Node::queue_command(const std::string& command, std::stringstream&& args) {
+Node::lane Node::command_lane(const name_ref& command) {
+    if (command == id<Update>() || command == id<Updates>() || command == id<Reupdate>() || command == id<Resync>())
+        return lane::Bulk;
+
+    return lane::Interactive;
+}
+
+size_t Node::queued_commands() {
+    size_t total = 0;
+    for (auto& queue : _command_queues) {
+        total += queue.size();
+    }
+
+    return total;
+}
+
+void Node::queue_command(const name_ref& command, message&& args) {
     // defer the actual lookup to the execution so we can handle commands that remove themselves
-    _command_queue.emplace(std::make_pair(command, std::move(args)));
+    auto& queue = _command_queues[static_cast<size_t>(command_lane(command))];
+    if (!queue.push(queued_command{ command, std::move(args), std::chrono::steady_clock::now() }))
+        debugf("MQ2DanNet: command queue is full, dropping %s.", command.str().c_str());
 }
 
 const std::string MQ2DanNet::Node::observer_group(const unsigned int key) {
     return _node_name + "_" + init_string(std::to_string(key).c_str());
 }
 
-void Node::do_next() {
-    std::pair<std::string, std::stringstream> command_pair = _command_queue.pop();
-    _command_map.erase_if(command_pair.first, [&command_pair](std::function<bool(std::stringstream &&)> f) -> bool {
-        return f(std::move(command_pair.second));
-    });
+bool Node::do_next() {
+    auto& interactive = _command_queues[static_cast<size_t>(lane::Interactive)];
+    auto& bulk = _command_queues[static_cast<size_t>(lane::Bulk)];
+    const queued_command* next_interactive = interactive.peek();
+    const queued_command* next_bulk = bulk.peek();
+    if (!next_interactive && !next_bulk)
+        return false;
+
+    const auto now = std::chrono::steady_clock::now();
+
+    // weighted round robin between the lanes, the credit carries over between pulses so a small drain budget still
+    // gets bulk results through, and a bulk result that has been waiting too long jumps the line
+    lane next = next_interactive ? lane::Interactive : lane::Bulk;
+    bool forced = false;
+    if (next_interactive && next_bulk) {
+        if (now - next_bulk->queued >= bulk_wait_limit) {
+            next = lane::Bulk;
+            forced = true;
+        } else if (_interactive_credit == 0) {
+            next = lane::Bulk;
+        }
+    }
+
+    if (next == lane::Bulk)
+        _interactive_credit = interactive_weight;
+    else if (_interactive_credit > 0)
+        --_interactive_credit;
+
+    queued_command command;
+    _command_queues[static_cast<size_t>(next)].pop(command);
+
+    lane_stats& stats = _lane_stats[static_cast<size_t>(next)];
+    ++stats.handled;
+    if (forced)
+        ++stats.forced;
+
+    const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(now - command.queued).count();
+    size_t bucket = 0;
+    while (bucket < std::size(wait_buckets) && waited >= wait_buckets[bucket])
+        ++bucket;
+    ++stats.waits[bucket];
+
+    _command_map.erase_if(command.command, [&command](std::function<bool(const message&)> f) -> bool {
+        return f(command.args);
+    });
+
+    return true;
+}
+
+void Node::drain() {
+    // always handle at least one command so a tiny budget can't stall the queue, then keep going until we run out of time
+    const auto start = std::chrono::steady_clock::now();
+    const auto budget = std::chrono::microseconds(_drain_budget);
+
+    size_t drained = 0;
+    while (do_next()) {
+        ++drained;
+        if (std::chrono::steady_clock::now() - start >= budget)
+            break;
+    }
+
+    _drain_stats.last = drained;
+    if (drained == 0)
+        return;
+
+    ++_drain_stats.pulses;
+    _drain_stats.commands += drained;
+    _drain_stats.microseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    _drain_stats.most = std::max(_drain_stats.most, drained);
+    if (queued_commands() > 0)
+        ++_drain_stats.exhausted;
 }
 
-void Node::remove_commands(const std::function<bool(std::pair<std::string, std::stringstream>&)>& f) {
-    _command_queue.remove_if(f);
+void Node::remove_commands(const std::function<bool(queued_command&)>& f) {
+    for (auto& queue : _command_queues) {
+        queue.remove_if(f);
+    }
 }
 
 #pragma endregion
 
 #pragma region Commands
 
-const bool MQ2DanNet::Echo::callback(std::stringstream&& args) {
-    Archive<std::stringstream> received(args);
-    std::string from;
-    std::string group;
-    std::string text;
+static void decode_echo(message& args) {
+    frame_reader received = args.reader();
+    args.decoded(std::string(std::get<0>(Echo::body::decode(received))));
+}
+
+const bool MQ2DanNet::Echo::callback(const message& args) {
+    Node& node = args.node();
+    frame_reader received = args.reader();
+    const std::string& group = args.group();
 
     try {
-        received >> from >> group >> text;
-        from = Node::get().get_name(from);
-        //DebugSpewAlways("ECHO --> FROM: %s, GROUP: %s, TEXT: %s", from.c_str(), group.c_str(), text.c_str());
+        const std::string* decoded = args.decoded<std::string>();
+        const std::string_view text = decoded ? std::string_view(*decoded) : std::get<0>(body::decode(received));
+        std::string from = node.get_name(args.from());
+        //DebugSpewAlways("ECHO --> FROM: %s, GROUP: %s, TEXT: %.*s", from.c_str(), group.c_str(), static_cast<int>(text.size()), text.data());
 
-        if (group.empty() || !Node::get().show_groups())
-            WriteChatf("\ax\a-t[\ax\at %s \ax\a-t]\ax \aw%s\ax", from.c_str(), text.c_str());
+        if (group.empty() || !node.show_groups())
+            node.chatf("\ax\a-t[\ax\at %s \ax\a-t]\ax \aw%.*s\ax", from.c_str(), static_cast<int>(text.size()), text.data());
         else
-            WriteChatf("\ax\a-t[\ax\at %s\ax\a-t (%s) ]\ax \aw%s\ax", from.c_str(), group.c_str(), text.c_str());
+            node.chatf("\ax\a-t[\ax\at %s\ax\a-t (%s) ]\ax \aw%.*s\ax", from.c_str(), group.c_str(), static_cast<int>(text.size()), text.data());
 
         return false;
     } catch (std::runtime_error&) {
-        DebugSpewAlways("MQ2DanNet::Echo -- Failed to deserialize.");
+        args.node().debugf("MQ2DanNet::Echo -- Failed to deserialize.");
         return false;
     }
 }
 
-std::stringstream MQ2DanNet::Echo::pack(const std::string& recipient, const std::string& message) {
-    std::stringstream send_stream;
-    Archive<std::stringstream> send(send_stream);
-    send << message;
+void MQ2DanNet::Echo::pack(Node& node, frame_buffer& frame, const std::string& recipient, const std::string& message) {
+    body::encode(frame, message);
+}
 
-    return send_stream;
+// the unescaping is the expensive part of Execute, so it is done here
+static std::string unescape_command(std::string_view command) {
+    static const std::regex escaped("\\$\\\\\\{");
+    return std::regex_replace(std::string(command), escaped, "${");
 }
 
-const bool MQ2DanNet::Execute::callback(std::stringstream&& args) {
-    Archive<std::stringstream> received(args);
-    std::string from;
-    std::string group;
-    std::string command;
+static void decode_execute(message& args) {
+    frame_reader received = args.reader();
+    args.decoded(unescape_command(std::get<0>(Execute::body::decode(received))));
+}
 
-    try {
-        received >> from >> group >> command;
-        //DebugSpewAlways("EXECUTE --> FROM: %s, GROUP: %s, TEXT: %s", from.c_str(), group.c_str(), command.c_str());
+const bool MQ2DanNet::Execute::callback(const message& args) {
+    Node& node = args.node();
+    frame_reader received = args.reader();
+    const std::string& from = args.from();
+    const std::string& group = args.group();
 
-        std::string final_command = std::regex_replace(command, std::regex("\\$\\\\\\{"), "${");
+    try {
+        const std::string* decoded = args.decoded<std::string>();
+        std::string final_command = decoded ? *decoded : unescape_command(std::get<0>(body::decode(received)));
+        //DebugSpewAlways("EXECUTE --> FROM: %s, GROUP: %s, TEXT: %s", from.c_str(), group.c_str(), final_command.c_str());
 
-        if (Node::get().command_echo()) {
+        if (node.command_echo()) {
             if (group.empty()) {
-                WriteChatf("\ax\a-o[\ax\ao %s \ax\a-o]\ax \aw%s\ax", from.c_str(), final_command.c_str());
+                node.chatf("\ax\a-o[\ax\ao %s \ax\a-o]\ax \aw%s\ax", from.c_str(), final_command.c_str());
             } else {
-                WriteChatf("\ax\a-o[\ax\ao %s\ax\a-o (%s) ]\ax \aw%s\ax", from.c_str(), group.c_str(), final_command.c_str());
+                node.chatf("\ax\a-o[\ax\ao %s\ax\a-o (%s) ]\ax \aw%s\ax", from.c_str(), group.c_str(), final_command.c_str());
             }
         }
 
-        CHAR szCommand[MAX_STRING] = { 0 };
-        strcpy_s(szCommand, final_command.c_str());
-        EzCommand(szCommand);
+        node.client().execute(final_command);
 
         return false;
     } catch (std::runtime_error&) {
-        DebugSpewAlways("MQ2DanNet::Echo -- Failed to deserialize.");
+        args.node().debugf("MQ2DanNet::Echo -- Failed to deserialize.");
         return false;
     }
 }
 
-std::stringstream MQ2DanNet::Execute::pack(const std::string& recipient, const std::string& command) {
-    std::stringstream send_stream;
-    Archive<std::stringstream> send(send_stream);
-    send << command;
-
-    return send_stream;
+void MQ2DanNet::Execute::pack(Node& node, frame_buffer& frame, const std::string& recipient, const std::string& command) {
+    body::encode(frame, command);
 }
 
-const bool MQ2DanNet::Query::callback(std::stringstream&& args) {
-    Archive<std::stringstream> received(args);
-    std::string from;
-    std::string group; // this is irrelevant, but we need to pull the parameter anyway.
-    std::string key;
-    std::string request;
+const bool MQ2DanNet::Query::callback(const message& args) {
+    Node& node = args.node();
+    frame_reader received = args.reader();
+    const std::string& from = args.from();
 
     try {
-        received >> from >> group >> key >> request;
-        //DebugSpewAlways("QUERY --> FROM: %s, GROUP: %s, REQUEST: %s", from.c_str(), group.c_str(), request.c_str());
-
-        std::stringstream send_stream;
-        Archive<std::stringstream> send(send_stream);
+        auto [key, request] = body::decode(received);
+        //DebugSpewAlways("QUERY --> FROM: %s, GROUP: %s, REQUEST: %.*s", from.c_str(), args.group().c_str(), static_cast<int>(request.size()), request.data());
 
-        send << Node::get().parse_query(request);
-        Node::get().respond(from, key, std::move(send_stream));
+        frame_buffer send_frame(node.peer_wire_version(from));
+        QueryResponse::encode(send_frame, node.parse_query(std::string(request)));
+        node.respond(from, std::string(key), std::move(send_frame));
 
         return false;
     } catch (std::runtime_error&) {
-        DebugSpewAlways("MQ2DanNet::Query -- Failed to deserialize.");
+        args.node().debugf("MQ2DanNet::Query -- Failed to deserialize.");
         return false;
     }
 }
 
 // we're going to generate a new command and register it with Node here in addition to packing
-std::stringstream MQ2DanNet::Query::pack(const std::string& recipient, const std::string& request) {
-    std::stringstream send_stream;
-    Archive<std::stringstream> send(send_stream);
-
+void MQ2DanNet::Query::pack(Node& node, frame_buffer& frame, const std::string& recipient, const std::string& request) {
     // now we make a callback for the Query command that sets the variable
-    auto f = [request](std::stringstream&& args) -> bool {
-        Archive<std::stringstream> ar(args);
-        std::string from;
-        std::string group;
-        std::string data;
+    auto f = [request](const message& args) -> bool {
+        Node& node = args.node();
+        frame_reader ar = args.reader();
+        const std::string& from = args.from();
 
         try {
-            ar >> from >> group >> data;
+            auto [result] = QueryResponse::decode(ar);
+            std::string data(result);
 
-            std::string output = Node::get().query(from, request).output;
-            MQTypeVar Result = Node::get().parse_response(output, data);
+            std::string output = node.query(from, request)->output;
+            const Node::stored_response stored = node.parse_response(output, data);
 
             // this actually only determines when the delay breaks.
-            CHAR szBuf[MAX_STRING] = { 0 };
-            if (Result.Type)
-                Result.Type->ToString(Result.VarPtr, szBuf);
-            else
-                strcpy_s(szBuf, "NULL");
-            Node::get().query_result(from, request, Node::Observation(output, std::string(szBuf), MQGetTickCount64()));
-
-            if (Node::get().debugging()) {
-                if (Result.Type) {
-                    CHAR szData[MAX_STRING] = { 0 };
-                    Result.Type->ToString(Result.VarPtr, szData);
-                    WriteChatf("%s : %s -- %llu (%llu)", Result.Type->GetName(), szData, Node::get().query(from, request).received, MQGetTickCount64());
-                } else
-                    WriteChatf("Failed to read data %s into %s at %llu.", data.c_str(), output.c_str(), MQGetTickCount64());
+            node.query_result(from, request, Node::Observation(output, stored.value, node.client().tick()));
+
+            if (node.debugging()) {
+                if (!stored.type.empty())
+                    node.chatf("%s : %s -- %llu (%llu)", stored.type.c_str(), stored.value.c_str(), node.query(from, request)->received, node.client().tick());
+                else
+                    node.chatf("Failed to read data %s into %s at %llu.", data.c_str(), output.c_str(), node.client().tick());
             }
         } catch (std::runtime_error&) {
-            DebugSpewAlways("MQ2DanNet::Query -- response -- Failed to deserialize.");
+            args.node().debugf("MQ2DanNet::Query -- response -- Failed to deserialize.");
         }
 
         return true;
     };
 
-    std::string key = Node::get().register_response(f);
-    send << key << request;
-
-    return send_stream;
+    std::string key = node.register_response(f);
+    body::encode(frame, key, request);
 }
 
 // this is the callback for the observable, so add to map and send back the result group to the requester
-const bool MQ2DanNet::Observe::callback(std::stringstream&& args) {
-    Archive<std::stringstream> received(args);
-    std::string from;
-    std::string group;
-    std::string key;
-    std::string query;
+const bool MQ2DanNet::Observe::callback(const message& args) {
+    Node& node = args.node();
+    frame_reader received = args.reader();
+    const std::string& from = args.from();
 
     try {
-        received >> from >> group >> key >> query;
-        //DebugSpewAlways("OBSERVE --> FROM: %s, GROUP: %s, QUERY: %s", from.c_str(), group.c_str(), query.c_str());
+        auto [key, view] = body::decode(received);
+        std::string query(view);
+        //DebugSpewAlways("OBSERVE --> FROM: %s, GROUP: %s, QUERY: %s", from.c_str(), args.group().c_str(), query.c_str());
 
-        std::stringstream args;
-        Archive<std::stringstream> ar(args);
+        unsigned int rate = 0;
+        unsigned int heartbeat = 0;
+        if (!received.empty())
+            std::tie(rate, heartbeat) = ObserveRate::decode(received);
+
+        frame_buffer send_frame(node.peer_wire_version(from));
 
         // This can install invalid queries, which is by design. We have no way to determine when some queries are valid or invalid
-        ar << Node::get().register_observer(from, query) << Node::get().parse_query(query);
+        ObserveResponse::encode(send_frame, node.register_observer(from, query, rate, heartbeat), node.parse_query(query));
 
-        Node::get().respond(from, key, std::move(args));
+        node.respond(from, std::string(key), std::move(send_frame));
     } catch (std::runtime_error&) {
-        DebugSpewAlways("MQ2DanNet::Observe -- Failed to deserialize.");
+        args.node().debugf("MQ2DanNet::Observe -- Failed to deserialize.");
     }
 
     return false;
 }
 
-std::stringstream MQ2DanNet::Observe::pack(const std::string& recipient, const std::string& query, const std::string& output) {
-    std::stringstream send_stream;
-    Archive<std::stringstream> send(send_stream);
-
-    std::string final_query = Node::get().trim_query(query);
+void MQ2DanNet::Observe::pack(Node& node, frame_buffer& frame, const std::string& recipient, const std::string& query, const std::string& output, unsigned int rate, unsigned int heartbeat) {
+    std::string final_query = node.trim_query(query);
+    node.observe_requested(recipient, final_query, rate, heartbeat);
 
-    if (recipient == Node::get().name()) {
-        std::string new_group = Node::get().register_observer(recipient, final_query);
-        Node::get().observe(new_group, recipient, final_query);
-        Node::get().update(new_group, "NULL", output);
+    if (recipient == node.name()) {
+        std::string new_group = node.register_observer(recipient, final_query, rate, heartbeat);
+        node.observe(new_group, recipient, final_query);
+        node.update(new_group, observed_value(), output);
 
-        std::stringstream self_send_stream;
-        Archive<std::stringstream> self_send(self_send_stream);
-
-        self_send << Node::get().name() << new_group << Node::get().parse_query(final_query);
-        Update::callback(std::move(self_send_stream));
+        frame_buffer self_send;
+        Update::body::encode(self_send, node.parse_query(final_query));
+        Update::callback(message(node, node.name(), new_group, std::move(self_send)));
 
         // this isn't going to get sent anywhere.
-        return std::stringstream();
+        return;
     }
 
     // this is the callback to actually start observing. We can't just do it because the observed will come back with the right group
-    auto f = [final_query, output](std::stringstream&& args) -> bool {
-        Archive<std::stringstream> ar(args);
-        std::string from;
-        std::string group;
-        std::string new_group;
-        std::string data;
+    auto f = [final_query, output](const message& args) -> bool {
+        Node& node = args.node();
+        frame_reader ar = args.reader();
 
         try {
-            ar >> from >> group >> new_group >> data;
+            auto [new_group, data] = ObserveResponse::decode(ar);
             if (!new_group.empty()) {
-                Node::get().observe(new_group, from, final_query);
-                Node::get().update(new_group, "NULL", output);
-
-                std::stringstream self_send_stream;
-                Archive<std::stringstream> self_send(self_send_stream);
+                node.observe(new_group, args.from(), final_query);
+                node.update(new_group, observed_value(), output);
 
-                self_send << Node::get().name() << new_group << data;
-                Update::callback(std::move(self_send_stream));
+                frame_buffer self_send;
+                Update::body::encode(self_send, data);
+                Update::callback(message(node, node.name(), new_group, std::move(self_send)));
             }
         } catch (std::runtime_error&) {
-            DebugSpewAlways("MQ2DanNet::Observe -- response -- Failed to deserialize.");
+            args.node().debugf("MQ2DanNet::Observe -- response -- Failed to deserialize.");
         }
 
         return true;
     };
 
     // this registers the response from the observed that responds with a group name
-    std::string key = Node::get().register_response(f);
-    send << key << final_query;
-    return send_stream;
+    std::string key = node.register_response(f);
+    body::encode(frame, key, final_query);
+    if (rate || heartbeat)
+        ObserveRate::encode(frame, rate, heartbeat);
 }
 
-const bool MQ2DanNet::Update::callback(std::stringstream&& args) {
-    Archive<std::stringstream> received(args);
-    std::string from;
-    std::string group;
-    std::string data;
+// stores a received observer result (shared by Update and Updates)
+static void apply_update(Node& node, const std::string& group, const observed_value& data) {
+    std::string output = node.read(group)->output;
+    if (output.empty()) {
+        // there's nothing to write it into, so keep the value as it came in
+        node.update(group, data, output);
+
+        if (node.debugging()) {
+            char szData[MAX_STRING] = { 0 };
+            data.to_string(szData, MAX_STRING);
+            node.chatf("%s -- %llu (%llu)", szData, node.read(group)->received, node.client().tick());
+        }
+
+        return;
+    }
+
+    if (node.client().has_variable(output)) {
+        // the variable's type gets the final say on the value, so this has to go through its FromString
+        const Node::stored_response result = node.parse_response(output, data.str());
+
+        node.update(group, observed_value::parse(result.value), output);
+
+        if (node.debugging()) {
+            if (!result.type.empty()) {
+                node.chatf("%s : %s -- %llu (%llu)", result.type.c_str(), result.value.c_str(), node.read(group)->received, node.client().tick());
+            } else
+                node.chatf("Failed to read data %s into %s at %llu.", data.str().c_str(), output.c_str(), node.client().tick());
+        }
+    } else {
+        // if we are storing to a variable, we need to drop the observer if the variable goes out of scope
+        node.forget(group);
+        if (node.debugging())
+            node.chatf("Could not find var %s at %llu.", output.c_str(), node.client().tick());
+    }
+}
+
+static observed_value decode_update_value(const message& args) {
+    const observed_value* decoded = args.decoded<observed_value>();
+    if (decoded)
+        return *decoded;
+
+    frame_reader received = args.reader();
+    return observed_value::parse(std::get<0>(Update::body::decode(received)));
+}
+
+static void decode_update(message& args) {
+    args.decoded(decode_update_value(args));
+}
+
+const bool MQ2DanNet::Update::callback(const message& args) {
+    Node& node = args.node();
+    const std::string& from = args.from();
+    const std::string& group = args.group();
 
     try {
-        received >> from >> group >> data;
-        Node::get().remove_commands([from, group, &data](std::pair<std::string, std::stringstream>& command) -> bool {
-            if (command.first == Node::name<Update>()) {
-                std::stringstream args_copy(command.second.str());
-                Archive<std::stringstream> recv(args_copy);
-                std::string copy_from, copy_group, copy_data;
-
-                recv >> copy_from >> copy_group >> copy_data;
-                if (from == copy_from && group == copy_group) {
-                    //DebugSpewAlways("DROPPING EXTRA UPDATE --> FROM: %s, GROUP: %s", from.c_str(), group.c_str());
-                    data = copy_data;
-                    return true;
+        observed_value data = decode_update_value(args);
+        node.remove_commands([&from, &group, &data](Node::queued_command& command) -> bool {
+            if (command.command == Node::id<Update>() && from == command.args.from() && group == command.args.group()) {
+                try {
+                    data = decode_update_value(command.args);
+                } catch (std::runtime_error&) {
+                    return false;
                 }
+
+                //DebugSpewAlways("DROPPING EXTRA UPDATE --> FROM: %s, GROUP: %s", from.c_str(), group.c_str());
+                return true;
             }
 
             return false;
         });
 
-        //DebugSpewAlways("UPDATE --> FROM: %s, GROUP: %s, DATA: %s", from.c_str(), group.c_str(), data.c_str());
+        //DebugSpewAlways("UPDATE --> FROM: %s, GROUP: %s, DATA: %s", from.c_str(), group.c_str(), data.str().c_str());
+        apply_update(node, group, data);
+    } catch (std::runtime_error&) {
+        args.node().debugf("MQ2DanNet::Update -- failed to deserialize.");
+    }
 
-        std::string output = Node::get().read(group).output;
-        CHAR szOutput[MAX_STRING] = { 0 };
-        strcpy_s(szOutput, output.c_str());
+    return false;
+}
 
-        if (output.empty() || FindMQ2DataVariable(szOutput)) {
-            MQTypeVar Result = Node::get().parse_response(output, data);
+void MQ2DanNet::Update::pack(Node& node, frame_buffer& frame, const std::string& recipient, const std::string& result) {
+    body::encode(frame, result);
 
-            CHAR szBuf[MAX_STRING] = { 0 };
-            if (Result.Type)
-                Result.Type->ToString(Result.VarPtr, szBuf);
-            else
-                strcpy_s(szBuf, "NULL");
+    // Update is never whispered, so we can assume that recipient is the group to update
+    auto groups = node.get_own_groups();
+    if (groups.find(recipient) != groups.end()) {
+        // also need to send this to self if we are observing self
+        frame_buffer self_send;
+        body::encode(self_send, result);
+        callback(message(node, node.name(), recipient, std::move(self_send)));
+    }
+}
 
-            Node::get().update(group, std::string(szBuf), output);
+const bool MQ2DanNet::Reupdate::callback(const message& args) {
+    Node& node = args.node();
+    std::string from = node.get_name(args.from());
+    args.node().debugf("REUPDATE --> FROM: %s, GROUP: %s", from.c_str(), args.group().c_str());
 
-            if (Node::get().debugging()) {
-                if (Result.Type) {
-                    CHAR szData[MAX_STRING] = { 0 };
-                    Result.Type->ToString(Result.VarPtr, szData);
-                    WriteChatf("%s : %s -- %llu (%llu)", Result.Type->GetName(), szData, Node::get().read(group).received, MQGetTickCount64());
-                } else
-                    WriteChatf("Failed to read data %s into %s at %llu.", data.c_str(), output.c_str(), MQGetTickCount64());
-            }
+    node.clear_observer_cache();
+
+    return false;
+}
+
+void MQ2DanNet::Reupdate::pack(Node& node, frame_buffer& frame, const std::string& recipient) {
+}
+
+// writes result as compactly as it will go, using previous as the base for a delta if it is a number with the same places
+static void write_value(frame_buffer& frame, const std::string& result, const std::string& previous) {
+    unsigned int places = 0;
+    __int64 mantissa = 0;
+    if (result == "NULL") {
+        frame.write_byte(static_cast<unsigned char>(value_tag::Null));
+    } else if (result == "TRUE") {
+        frame.write_byte(static_cast<unsigned char>(value_tag::True));
+    } else if (result == "FALSE") {
+        frame.write_byte(static_cast<unsigned char>(value_tag::False));
+    } else if (parse_number(result, places, mantissa)) {
+        unsigned int previous_places = 0;
+        __int64 previous_mantissa = 0;
+        if (!previous.empty() && parse_number(previous, previous_places, previous_mantissa) && previous_places == places) {
+            frame.write_byte(static_cast<unsigned char>(value_tag::NumberDelta));
+            frame.write_varint(zigzag_encode(mantissa - previous_mantissa));
         } else {
-            // if we are storing to a variable, we need to drop the observer if the variable goes out of scope
-            Node::get().forget(group);
-            if (Node::get().debugging())
-                WriteChatf("Could not find var %s at %llu.", output.c_str(), MQGetTickCount64());
+            frame.write_byte(static_cast<unsigned char>(value_tag::Number));
+            frame.write_varint(places);
+            frame.write_varint(zigzag_encode(mantissa));
         }
-    } catch (std::runtime_error&) {
-        DebugSpewAlways("MQ2DanNet::Update -- failed to deserialize.");
+    } else {
+        frame.write_byte(static_cast<unsigned char>(value_tag::String));
+        frame << result;
     }
+}
 
-    return false;
+// one record of an Updates batch, read as far as it can be without knowing what the receiver already has
+struct updates_entry final {
+    std::string group;
+    unsigned __int64 sequence = 0;
+    bool delta = false;    // change applies on top of the result with sequence - 1
+    __int64 change = 0;    // only if delta
+    observed_value result; // only if not delta
+};
+
+struct updates_batch final {
+    unsigned __int64 serial = 0;
+    std::vector<updates_entry> records;
+};
+
+// reads a value written by write_value
+static void read_value(frame_reader& reader, updates_entry& entry) {
+    unsigned char tag = 0;
+    reader.read_byte(tag);
+    switch (static_cast<value_tag>(tag)) {
+    case value_tag::String: {
+        std::string text;
+        reader >> text;
+        entry.result = observed_value::string(std::move(text));
+        return;
+    }
+    case value_tag::Null:
+        entry.result = observed_value();
+        return;
+    case value_tag::True:
+        entry.result = observed_value::boolean(true);
+        return;
+    case value_tag::False:
+        entry.result = observed_value::boolean(false);
+        return;
+    case value_tag::Number: {
+        unsigned __int64 places = 0, mantissa = 0;
+        reader.read_varint(places).read_varint(mantissa);
+        entry.result = observed_value::number(static_cast<unsigned int>(places), zigzag_decode(mantissa));
+        return;
+    }
+    case value_tag::NumberDelta: {
+        unsigned __int64 delta = 0;
+        reader.read_varint(delta);
+        entry.delta = true;
+        entry.change = zigzag_decode(delta);
+        return;
+    }
+    default:
+        throw std::runtime_error("malformed data");
+    }
 }
 
-std::stringstream MQ2DanNet::Update::pack(const std::string& recipient, const std::string& result) {
-    std::stringstream send_stream;
+// previous is null if we don't have the result the sender based a delta on, in which case this returns false
+static bool resolve_value(const updates_entry& entry, const observed_value* previous, observed_value& result) {
+    if (!entry.delta) {
+        result = entry.result;
+        return true;
+    }
 
-    Archive<std::stringstream> send(send_stream);
-    send << result;
+    if (!previous || !previous->is_number())
+        return false;
 
-    // Update is never whispered, so we can assume that recipient is the group to update
-    auto groups = Node::get().get_own_groups();
-    if (groups.find(recipient) != groups.end()) {
-        // also need to send this to self if we are observing self
-        std::stringstream self_send_stream;
-        Archive<std::stringstream> self_send(self_send_stream);
+    result = observed_value::number(previous->places(), previous->mantissa() + entry.change);
+    return true;
+}
 
-        self_send << Node::get().name() << recipient << result;
-        callback(std::move(self_send_stream));
+static updates_batch read_batch(const message& args) {
+    frame_reader reader = args.reader();
+    updates_batch batch;
+    batch.serial = std::get<0>(Updates::body::decode(reader));
+    while (!reader.empty()) {
+        auto [group, sequence] = UpdatesRecord::decode(reader);
+        updates_entry& entry = batch.records.emplace_back();
+        entry.group = std::move(group);
+        entry.sequence = sequence;
+        read_value(reader, entry);
     }
 
-    return send_stream;
+    return batch;
 }
 
-const bool MQ2DanNet::Reupdate::callback(std::stringstream&& args) {
-    Archive<std::stringstream> received(args);
-    std::string from;
-    std::string group;
+static void decode_updates(message& args) {
+    args.decoded(read_batch(args));
+}
 
-    try {
-        received >> from >> group;
-        from = Node::get().get_name(from);
-        DebugSpewAlways("REUPDATE --> FROM: %s, GROUP: %s", from.c_str(), group.c_str());
+const bool MQ2DanNet::Updates::callback(const message& args) {
+    Node& node = args.node();
+    const std::string& from = args.from();
 
-		Node::get().clear_observer_cache();
+    // take any batches from the same peer that are still waiting in the queue, so that all of them are applied in one
+    // pass in the order they were sent, and only the latest result for each group is parsed
+    std::vector<message> queued;
+    node.remove_commands([&from, &queued](Node::queued_command& command) -> bool {
+        if (command.command == Node::id<Updates>() && command.args.from() == from) {
+            queued.push_back(std::move(command.args));
+            return true;
+        }
 
         return false;
+    });
+
+    try {
+        // batches are normally decoded by the actor already, anything that wasn't is decoded into undecoded
+        std::list<updates_batch> undecoded;
+        std::map<unsigned __int64, const updates_batch*> batches; // serial, records
+        auto add_batch = [&batches, &undecoded](const message& batch) -> void {
+            const updates_batch* decoded = batch.decoded<updates_batch>();
+            if (!decoded)
+                decoded = &undecoded.emplace_back(read_batch(batch));
+            batches.emplace(decoded->serial, decoded);
+        };
+
+        add_batch(args);
+        for (auto& batch : queued) {
+            add_batch(batch);
+        }
+
+        std::map<std::string, std::pair<unsigned __int64, observed_value>> results; // group, sequence and result
+        std::set<std::string> resync;
+        for (auto& batch : batches) {
+            for (auto& entry : batch.second->records) {
+                auto result = results.find(entry.group);
+                if (result == results.end()) {
+                    result = results.emplace(entry.group, std::make_pair(0ULL, observed_value())).first;
+                    result->second.first = node.last_sequence(entry.group, result->second.second);
+                }
+
+                // a delta can only be applied on top of the result right before it
+                const bool in_order = result->second.first != 0 && result->second.first + 1 == entry.sequence;
+                observed_value value;
+                if (!resolve_value(entry, in_order ? &result->second.second : nullptr, value)) {
+                    resync.emplace(entry.group);
+                } else {
+                    result->second = std::make_pair(entry.sequence, std::move(value));
+                    resync.erase(entry.group);
+                }
+            }
+        }
+
+        //DebugSpewAlways("UPDATES --> FROM: %s, BATCHES: %u, RESULTS: %u", from.c_str(), batches.size(), results.size());
+        for (auto& result : results) {
+            // whatever we had for a group that needs a resync is stale, so leave it until the full result comes back
+            if (resync.find(result.first) != resync.end())
+                continue;
+
+            node.sequence(result.first, result.second.first, result.second.second);
+            apply_update(node, result.first, result.second.second);
+        }
+
+        if (!resync.empty())
+            node.whisper<Resync>(from, resync);
     } catch (std::runtime_error&) {
-        DebugSpewAlways("MQ2DanNet::Reupdate -- Failed to deserialize.");
-        return false;
+        args.node().debugf("MQ2DanNet::Updates -- failed to deserialize.");
+    }
+
+    return false;
+}
+
+void MQ2DanNet::Updates::pack(Node& node, frame_buffer& frame, const std::string& recipient, unsigned __int64 serial, const std::map<std::string, update_record>& records) {
+    body::encode(frame, serial);
+    for (auto& record : records) {
+        UpdatesRecord::encode(frame, record.first, record.second.sequence);
+        write_value(frame, record.second.result, record.second.previous);
+    }
+}
+
+const bool MQ2DanNet::Resync::callback(const message& args) {
+    Node& node = args.node();
+    frame_reader received = args.reader();
+
+    try {
+        while (!received.empty()) {
+            auto [group] = body::decode(received);
+            //DebugSpewAlways("RESYNC --> FROM: %s, GROUP: %s", args.from().c_str(), group.c_str());
+            node.resync(group);
+        }
+    } catch (std::runtime_error&) {
+        args.node().debugf("MQ2DanNet::Resync -- failed to deserialize.");
+    }
+
+    return false;
+}
+
+void MQ2DanNet::Resync::pack(Node& node, frame_buffer& frame, const std::string& recipient, const std::set<std::string>& groups) {
+    for (auto& group : groups) {
+        body::encode(frame, group);
     }
 }
 
-std::stringstream MQ2DanNet::Reupdate::pack(const std::string& recipient) {
-    return std::stringstream();
+const bool MQ2DanNet::Probe::callback(const message& args) {
+    // the actor answers these before they'd get here
+    return false;
+}
+
+void MQ2DanNet::Probe::pack(Node& node, frame_buffer& frame, const std::string& recipient, bool reply, unsigned __int64 sent) {
+    body::encode(frame, reply, sent);
 }
 
 #pragma endregion
 
+#ifndef MQ2DANNET_HEADLESS
+
 #pragma region MainPlugin
 
+// the host for the plugin's own node, straight through to MQ
+class mq_host final : public host {
+public:
+    std::string evaluate(const std::string& expression) override {
+        CHAR szExpression[MAX_STRING] = { 0 };
+        strcpy_s(szExpression, expression.c_str());
+        ParseMacroData(szExpression, MAX_STRING);
+        return szExpression;
+    }
+
+    void execute(const std::string& command) override {
+        CHAR szCommand[MAX_STRING] = { 0 };
+        strcpy_s(szCommand, command.c_str());
+        EzCommand(szCommand);
+    }
+
+    void write_chat(const std::string& text) override { WriteChatf("%s", text.c_str()); }
+
+    std::string server_name() override { return GetServerShortName(); }
+
+    unsigned __int64 tick() override { return MQGetTickCount64(); }
+
+    void debug(const std::string& text) override { DebugSpewAlways("%s", text.c_str()); }
+
+    std::string setting(const std::string& section, const std::string& key) override {
+        CHAR szBuf[MAX_STRING] = { 0 };
+        GetPrivateProfileString(section.c_str(), key.c_str(), NULL, szBuf, MAX_STRING, INIFileName);
+        return szBuf;
+    }
+
+    std::string character_name() override {
+        PCHARINFO pChar = GetCharInfo();
+        return pChar ? pChar->Name : std::string();
+    }
+
+    bool on_main_thread() override { return IsMainThread(); }
+
+    void post(std::function<void()> f) override { PostToMainThread(std::move(f)); }
+
+    bool in_macro() override { return gMacroBlock != nullptr; }
+
+    bool has_variable(const std::string& name) override {
+        CHAR szName[MAX_STRING] = { 0 };
+        strcpy_s(szName, name.c_str());
+        return FindMQ2DataVariable(szName) != nullptr;
+    }
+
+    bool store(const std::string& variable, const std::string& data, std::string& type, std::string& value) override {
+        CHAR szOutput[MAX_STRING] = { 0 };
+        strcpy_s(szOutput, variable.c_str());
+        MQDataVar* pVar = FindMQ2DataVariable(szOutput);
+        if (!pVar)
+            return false;
+
+        CHAR szData[MAX_STRING] = { 0 };
+        strcpy_s(szData, data.c_str());
+        if (!pVar->Var.Type->FromString(pVar->Var.VarPtr, szData)) {
+            MacroError("/dquery: setting '%s' failed, variable type rejected new value of %s", szOutput, szData);
+        }
+
+        CHAR szBuf[MAX_STRING] = { 0 };
+        pVar->Var.Type->ToString(pVar->Var.VarPtr, szBuf);
+        type = pVar->Var.Type->GetName();
+        value = szBuf;
+        return true;
+    }
+
+    void macro_error(const std::string& text) override { MacroError("%s", text.c_str()); }
+};
+
+MQ2DANNET_NODE_API Node& Node::get() {
+    static mq_host client;
+    static Node instance(client);
+    return instance;
+}
+
+
 std::string GetDefault(std::string_view val) {
     if (val == "Debugging")
         return std::string("off");
@@ -2089,6 +4492,8 @@ std::string GetDefault(std::string_view val) {
         return std::string("on");
     else if (val == "Observe Delay")
         return std::string("1000");
+    else if (val == "Drain Budget")
+        return std::string("2000");
     else if (val == "Evasive")
         return std::string("5000");
     else if (val == "Expired")
@@ -2191,14 +4596,17 @@ public:
     }
 
     virtual bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) override {
-        MQTypeMember* pMember = MQ2DanObservationType::FindMember(Member);
-        if (!pMember)
-            return false;
-
         Node::Observation* pObservation = ((Node::Observation*)VarPtr.Ptr);
         if (!pObservation)
             return false;
 
+        MQTypeMember* pMember = MQ2DanObservationType::FindMember(Member);
+        if (!pMember) {
+            // anything we don't have is a member of the value itself, so hand it off to the value's own type
+            MQTypeVar Value;
+            return GetValue(pObservation->data, Value) && Value.Type->GetMember(Value.VarPtr, Member, Index, Dest);
+        }
+
         switch ((Members)pMember->ID) {
         case Received:
             Dest.UInt64 = pObservation->received;
@@ -2214,23 +4622,53 @@ public:
         if (!pObservation)
             return false;
 
-        strcpy_s(Destination, MAX_STRING, pObservation->data.c_str());
+        pObservation->data.to_string(Destination, MAX_STRING);
         return true;
     }
 
-    void InitVariable(MQVarPtr& VarPtr) {
-        VarPtr.Ptr = malloc(sizeof(Node::Observation));
+    // the value as its MQ type: int (int64 if it won't fit), double, bool or string. NULL has no type.
+    static bool GetValue(const observed_value& value, MQTypeVar& Dest) {
+        switch (value.type()) {
+        case observed_value::kind::Int:
+            if (value.as_int() >= std::numeric_limits<int>::min() && value.as_int() <= std::numeric_limits<int>::max()) {
+                Dest.Int = static_cast<int>(value.as_int());
+                Dest.Type = mq::datatypes::pIntType;
+            } else {
+                Dest.Int64 = value.as_int();
+                Dest.Type = mq::datatypes::pInt64Type;
+            }
+            return true;
+        case observed_value::kind::Decimal:
+            Dest.Double = value.as_double();
+            Dest.Type = mq::datatypes::pDoubleType;
+            return true;
+        case observed_value::kind::Bool:
+            Dest.DWord = value.as_bool() ? 1 : 0;
+            Dest.Type = mq::datatypes::pBoolType;
+            return true;
+        case observed_value::kind::String:
+            Dest.Ptr = const_cast<char*>(value.text().c_str());
+            Dest.Type = mq::datatypes::pStringType;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Observation holds strings, so it has to be constructed, copied and destroyed properly rather than as raw memory
+    void InitVariable(MQVarPtr& VarPtr) override {
+        VarPtr.Ptr = new Node::Observation();
         VarPtr.HighPart = 0;
-        ZeroMemory(VarPtr.Ptr, sizeof(Node::Observation));
     }
 
-    void FreeVariable(MQVarPtr& VarPtr) {
-        free(VarPtr.Ptr);
+    void FreeVariable(MQVarPtr& VarPtr) override {
+        delete static_cast<Node::Observation*>(VarPtr.Ptr);
+        VarPtr.Ptr = nullptr;
     }
 
     bool FromData(MQVarPtr& VarPtr, const MQTypeVar& Source) override {
         if (Source.Type == pDanObservationType) {
-            memcpy(VarPtr.Ptr, Source.Ptr, sizeof(Node::Observation));
+            *static_cast<Node::Observation*>(VarPtr.Ptr) = *static_cast<const Node::Observation*>(Source.Ptr);
             return true;
         }
 
@@ -2242,12 +4680,19 @@ class MQ2DanNetType* pDanNetType = nullptr;
 class MQ2DanNetType : public MQ2Type {
 private:
     std::string _peer;
-    std::set<std::string> _peers;
-    std::set<std::string> _groups;
-    std::set<std::string> _joined;
     CHAR _buf[MAX_STRING];
 
-    Node::Observation _current_observation;
+    // indexes into one of the membership sets, nullptr if out of range
+    static const std::string* at_index(const std::set<std::string>& items, const char* Index) {
+        const int idx = GetIntFromString(Index, 0) - 1;
+        if (idx < 0 || idx >= static_cast<int>(items.size()))
+            return nullptr;
+
+        return &*std::next(items.cbegin(), idx);
+    }
+
+    // holds on to the observation handed out last, so that it stays valid while the parser is using it
+    std::shared_ptr<const Node::Observation> _current_observation;
 
 public:
     enum Members {
@@ -2261,6 +4706,9 @@ public:
         ShowGroups,
         Timeout,
         ObserveDelay,
+        DrainBudget,
+        Backlog,
+        Drained,
         Evasive,
 		EvasiveRefresh,
         Expired,
@@ -2282,7 +4730,13 @@ public:
         Q,
         Query,
         QReceived,
-        QueryReceived
+        QueryReceived,
+        RTT,
+        LastSeen,
+        EvasiveCount,
+        SilentCount,
+        MessagesIn,
+        MessagesOut
     };
 
     MQ2DanNetType() : MQ2Type("DanNet") {
@@ -2296,6 +4750,9 @@ public:
         TypeMember(ShowGroups);
         TypeMember(Timeout);
         TypeMember(ObserveDelay);
+        TypeMember(DrainBudget);
+        TypeMember(Backlog);
+        TypeMember(Drained);
         TypeMember(Evasive);
         TypeMember(EvasiveRefresh);
         TypeMember(Expired);
@@ -2318,6 +4775,12 @@ public:
         TypeMember(Query);
         TypeMember(QReceived);
         TypeMember(QueryReceived);
+        TypeMember(RTT);
+        TypeMember(LastSeen);
+        TypeMember(EvasiveCount);
+        TypeMember(SilentCount);
+        TypeMember(MessagesIn);
+        TypeMember(MessagesOut);
     }
 
     virtual bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) override {
@@ -2374,6 +4837,18 @@ public:
             Dest.DWord = Node::get().observe_delay();
             Dest.Type = mq::datatypes::pIntType;
             return true;
+        case DrainBudget:
+            Dest.DWord = Node::get().drain_budget();
+            Dest.Type = mq::datatypes::pIntType;
+            return true;
+        case Backlog:
+            Dest.DWord = static_cast<uint32_t>(Node::get().backlog());
+            Dest.Type = mq::datatypes::pIntType;
+            return true;
+        case Drained:
+            Dest.DWord = static_cast<uint32_t>(Node::get().last_drained());
+            Dest.Type = mq::datatypes::pIntType;
+            return true;
         case Evasive:
             Dest.DWord = Node::get().evasive();
             Dest.Type = mq::datatypes::pIntType;
@@ -2390,121 +4865,96 @@ public:
             Dest.DWord = Node::get().keepalive();
             Dest.Type = mq::datatypes::pIntType;
             return true;
-        case PeerCount:
+        case PeerCount: {
+            const auto members = Node::get().snapshot();
             if (IsNumber(Index)) {
-                if (_groups.empty())
-                    _groups = Node::get().get_all_groups();
-                int idx = GetIntFromString(Index, 0) - 1;
-                auto group_it = _groups.cbegin();
-                std::advance(group_it, idx);
-                if (group_it != _groups.cend())
-                    Dest.DWord = static_cast<uint32_t>(Node::get().get_group_peers(*group_it).size());
-                else
+                const std::string* group = at_index(members->group_names(), Index);
+                if (!group)
                     return false;
+                Dest.DWord = static_cast<uint32_t>(members->group_members(*group).size());
             } else if (Index && Index[0] != '\0') {
-                Dest.DWord = static_cast<uint32_t>(Node::get().get_group_peers(Node::init_string(Index)).size());
+                Dest.DWord = static_cast<uint32_t>(members->group_members(Node::init_string(Index)).size());
             } else {
-                Dest.DWord = static_cast<uint32_t>(Node::get().get_peers().size());
+                Dest.DWord = static_cast<uint32_t>(members->names->size());
             }
             Dest.Type = mq::datatypes::pIntType;
             return true;
-        case Peers:
+        }
+        case Peers: {
+            const auto members = Node::get().snapshot();
             if (IsNumber(Index)) {
-                if (_peers.empty())
-                    _peers = Node::get().get_peers();
-                int idx = GetIntFromString(Index, 0) - 1;
-                if (idx < 0 || idx >= static_cast<int>(_peers.size()))
-                    return false;
-                auto peer_it = _peers.cbegin();
-                std::advance(peer_it, idx);
-                if (peer_it != _peers.cend()) {
-                    std::string out = Node::get().get_name(*peer_it);
-                    strcpy_s(_buf, out.c_str());
-                } else
+                const std::string* peer = at_index(members->peer_names(), Index);
+                if (!peer)
                     return false;
-            } else if (Index && Index[0] != '\0') {
-                auto peers = Node::get().get_group_peers(Node::init_string(Index));
-                std::set<std::string> out;
-                if (Node::get().full_names())
-                    out = peers;
-                else {
-                    std::transform(peers.cbegin(), peers.cend(), std::inserter(out, out.begin()), [](std::string s) -> std::string {
-                        return Node::get().get_short_name(s);
-                    });
-                }
-                strcpy_s(_buf, CreateArray(out).c_str());
+                strcpy_s(_buf, Node::get().get_name(*peer).c_str());
             } else {
-                auto peers = Node::get().get_peers();
-                std::set<std::string> out;
+                std::set<std::string> in_group;
+                if (Index && Index[0] != '\0')
+                    in_group = Node::membership::strings(members->group_members(Node::init_string(Index)));
+                const std::set<std::string>& peers = Index && Index[0] != '\0' ? in_group : members->peer_names();
                 if (Node::get().full_names())
-                    out = peers;
+                    strcpy_s(_buf, CreateArray(peers).c_str());
                 else {
-                    std::transform(peers.cbegin(), peers.cend(), std::inserter(out, out.begin()), [](std::string s) -> std::string {
+                    std::set<std::string> out;
+                    std::transform(peers.cbegin(), peers.cend(), std::inserter(out, out.begin()), [](const std::string& s) -> std::string {
                         return Node::get().get_short_name(s);
                     });
+                    strcpy_s(_buf, CreateArray(out).c_str());
                 }
-                strcpy_s(_buf, CreateArray(out).c_str());
             }
 
             Dest.Ptr = &_buf[0];
             Dest.Type = mq::datatypes::pStringType;
             return true;
+        }
         case GroupCount:
-            _groups = Node::get().get_all_groups();
-            Dest.DWord = static_cast<uint32_t>(_groups.size());
+            Dest.DWord = static_cast<uint32_t>(Node::get().snapshot()->groups->size());
             Dest.Type = mq::datatypes::pIntType;
             return true;
-        case Groups:
+        case Groups: {
+            const auto members = Node::get().snapshot();
             if (IsNumber(Index)) {
-                if (_groups.empty())
-                    _groups = Node::get().get_all_groups();
-                int idx = GetIntFromString(Index, 0) - 1;
-                auto group_it = _groups.cbegin();
-                std::advance(group_it, idx);
-                if (group_it != _groups.cend())
-                    strcpy_s(_buf, group_it->c_str());
-                else
+                const std::string* group = at_index(members->group_names(), Index);
+                if (!group)
                     return false;
+                strcpy_s(_buf, group->c_str());
             } else {
-                strcpy_s(_buf, CreateArray(Node::get().get_all_groups()).c_str());
+                strcpy_s(_buf, CreateArray(members->group_names()).c_str());
             }
             Dest.Ptr = &_buf[0];
             Dest.Type = mq::datatypes::pStringType;
             return true;
+        }
         case JoinedCount:
-            _joined = Node::get().get_own_groups();
-            Dest.DWord = static_cast<uint32_t>(_groups.size());
+            Dest.DWord = static_cast<uint32_t>(Node::get().snapshot()->own_groups->size());
             Dest.Type = mq::datatypes::pIntType;
             return true;
-        case Joined:
+        case Joined: {
+            const auto members = Node::get().snapshot();
             if (IsNumber(Index)) {
-                if (_joined.empty())
-                    _joined = Node::get().get_own_groups();
-                int idx = GetIntFromString(Index, 0) - 1;
-                auto group_it = _joined.cbegin();
-                std::advance(group_it, idx);
-                if (group_it != _joined.cend())
-                    strcpy_s(_buf, group_it->c_str());
-                else
+                const std::string* group = at_index(members->own_group_names(), Index);
+                if (!group)
                     return false;
+                strcpy_s(_buf, group->c_str());
             } else {
-                strcpy_s(_buf, CreateArray(Node::get().get_own_groups()).c_str());
+                strcpy_s(_buf, CreateArray(members->own_group_names()).c_str());
             }
             Dest.Ptr = &_buf[0];
             Dest.Type = mq::datatypes::pStringType;
             return true;
+        }
         case Q:
         case Query:
             if (!local_peer.empty() && Index && Index[0] != '\0') {
                 // only allow indexed query access if both peer and query are specified
-                _current_observation = Node::Observation(Node::get().query(local_peer, Index));
+                _current_observation = Node::get().query(local_peer, Index);
             } else {
                 // ignore all indexing and silently just provide the last result
-                _current_observation = Node::Observation(Node::get().query());
+                _current_observation = Node::get().query();
             }
 
-            if (_current_observation.received != 0) {
-                Dest.Ptr = &_current_observation;
+            if (_current_observation->received != 0) {
+                Dest.Ptr = const_cast<Node::Observation*>(_current_observation.get());
                 Dest.Type = pDanObservationType;
                 return true;
             } else
@@ -2513,13 +4963,13 @@ public:
         case QueryReceived:
             if (!local_peer.empty() && Index && Index[0] != '\0') {
                 // only allow indexed query access if both peer and query are specified
-                _current_observation = Node::Observation(Node::get().query(local_peer, Index));
+                _current_observation = Node::get().query(local_peer, Index);
             } else {
                 // ignore all indexing and silently just provide the last result
-                _current_observation = Node::Observation(Node::get().query());
+                _current_observation = Node::get().query();
             }
 
-            Dest.UInt64 = _current_observation.received;
+            Dest.UInt64 = _current_observation->received;
             Dest.Type = mq::datatypes::pInt64Type;
             return true;
         case O:
@@ -2528,8 +4978,8 @@ public:
                 if (Index && Index[0] != '\0') {
                     _current_observation = Node::get().read(local_peer, Node::get().trim_query(Index));
 
-                    if (_current_observation.received != 0) {
-                        Dest.Ptr = &_current_observation;
+                    if (_current_observation->received != 0) {
+                        Dest.Ptr = const_cast<Node::Observation*>(_current_observation.get());
                         Dest.Type = pDanObservationType;
                         return true;
                     } else
@@ -2598,11 +5048,47 @@ public:
         case ObserveReceived:
             if (!local_peer.empty() && Index && Index[0] != '\0') {
                 _current_observation = Node::get().read(local_peer, Node::get().trim_query(Index));
-                Dest.UInt64 = _current_observation.received;
+                Dest.UInt64 = _current_observation->received;
                 Dest.Type = mq::datatypes::pInt64Type;
                 return true;
             } else
                 return false;
+        case RTT:
+        case LastSeen:
+        case EvasiveCount:
+        case SilentCount:
+        case MessagesIn:
+        case MessagesOut: {
+            // NULL for ourselves, and for anyone the actor has nothing on (not connected, or already gone)
+            Node::peer_health health;
+            if (local_peer.empty() || !Node::get().health(local_peer, health))
+                return false;
+
+            Dest.Type = mq::datatypes::pInt64Type;
+            switch ((Members)pMember->ID) {
+            case RTT:
+                Dest.Double = health.rtt / 1000.0;
+                Dest.Type = mq::datatypes::pDoubleType;
+                return true;
+            case LastSeen:
+                Dest.UInt64 = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - health.last_seen).count();
+                return true;
+            case EvasiveCount:
+                Dest.UInt64 = health.evasive;
+                return true;
+            case SilentCount:
+                Dest.UInt64 = health.silent;
+                return true;
+            case MessagesIn:
+                Dest.UInt64 = health.messages_in;
+                return true;
+            case MessagesOut:
+                Dest.UInt64 = health.messages_out;
+                return true;
+            default:
+                return false;
+            }
+        }
         }
 
         return false;
@@ -2693,11 +5179,14 @@ void show_dnet_commands() {
     WriteChatf("           \ayshowgroups [on|off]\ax -- show groups in /dgtell receive messages");
     WriteChatf("           \aytimeout [new_timeout]\ax -- set the /dquery timeout");
     WriteChatf("           \ayobservedelay [new_delay]\ax -- set the delay between observe sends in ms");
+    WriteChatf("           \aydrainbudget [new_budget]\ax -- set the time spent handling incoming commands each pulse in us");
     WriteChatf("           \ayevasive [new_evasive]\ax -- set the evasive timeout in ms");
     WriteChatf("           \ayevasiverefresh [on|off]\ax -- turn evasive refresh on or off");
     WriteChatf("           \ayexpired [new_expired]\ax -- set the expired timeout in ms");
     WriteChatf("           \aykeepalive [new_keepalive]\ax -- set the keepalive time for non-responding peers in ms");
     WriteChatf("           \ayinfo\ax -- output group/peer information");
+    WriteChatf("           \aystats\ax -- output network statistics");
+    WriteChatf("           \aypeers\ax -- output round trip times and traffic for each peer");
 }
 
 PLUGIN_API VOID DNetCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
@@ -2749,6 +5238,13 @@ PLUGIN_API VOID DNetCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
             else
                 SetVar("General", "Observe Delay", GetDefault("Observe Delay"));
             Node::get().observe_delay(GetIntFromString(ReadVar("Observe Delay").c_str(), 0));
+        } else if (ci_equals(szParam, "drainbudget")) {
+            GetArg(szParam, szLine, 2);
+            if (szParam[0] && IsNumber(szParam))
+                SetVar("General", "Drain Budget", szParam);
+            else
+                SetVar("General", "Drain Budget", GetDefault("Drain Budget"));
+            Node::get().drain_budget(GetIntFromString(ReadVar("Drain Budget").c_str(), 0));
         } else if (ci_equals(szParam, "evasive")) {
             GetArg(szParam, szLine, 2);
             if (szParam[0] && IsNumber(szParam))
@@ -2778,6 +5274,16 @@ PLUGIN_API VOID DNetCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
             for (std::string info : Node::get().get_info()) {
                 WriteChatf("%s", info.c_str());
             }
+        } else if (ci_equals(szParam, "stats")) {
+            WriteChatf("\ax\atMQ2DanNet\ax :: \aystats\ax");
+            for (std::string stat : Node::get().get_stats()) {
+                WriteChatf("%s", stat.c_str());
+            }
+        } else if (ci_equals(szParam, "peers")) {
+            WriteChatf("\ax\atMQ2DanNet\ax :: \aypeers\ax");
+            for (std::string peer : Node::get().get_peer_health()) {
+                WriteChatf("%s", peer.c_str());
+            }
         } else if (ci_equals(szParam, "version")) {
             WriteChatf("\ax\atMQ2DanNet\ax :: \ayv%1.4f\ax", MQ2Version);
         } else {
@@ -3059,6 +5565,8 @@ PLUGIN_API VOID DObserveCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
 
     std::string query;
     std::string output;
+    unsigned int rate = 0;
+    unsigned int heartbeat = 0;
     bool drop = false;
 
     int current_param = 1;
@@ -3072,6 +5580,14 @@ PLUGIN_API VOID DObserveCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
             GetArg(szParam, szLine, ++current_param);
             if (szParam[0])
                 output = szParam;
+        } else if (!strncmp(szParam, "-r", 2)) {
+            GetArg(szParam, szLine, ++current_param);
+            if (szParam[0] && IsNumber(szParam))
+                rate = GetIntFromString(szParam, 0);
+        } else if (!strncmp(szParam, "-h", 2)) {
+            GetArg(szParam, szLine, ++current_param);
+            if (szParam[0] && IsNumber(szParam))
+                heartbeat = GetIntFromString(szParam, 0);
         } else if (!strncmp(szParam, "-d", 2)) {
             drop = true;
         } else if (szParam[0] == '-') {
@@ -3086,7 +5602,7 @@ PLUGIN_API VOID DObserveCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
         else
             Node::get().forget(name, query);
     } else if (name.empty() || query.empty()) {
-        WriteChatColor("Syntax: /dobserve <name> [-q <query>] [-o <result>] [-drop] -- add an observer on name and update values in result, or drop the observer", USERCOLOR_DEFAULT);
+        WriteChatColor("Syntax: /dobserve <name> [-q <query>] [-o <result>] [-r <rate>] [-h <heartbeat>] [-drop] -- add an observer on name and update values in result, or drop the observer", USERCOLOR_DEFAULT);
     } else {
         auto peers = Node::get().get_peers();
         if (peers.find(name) == peers.end()) {
@@ -3100,8 +5616,10 @@ PLUGIN_API VOID DObserveCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
             Node::get().forget_if(DoesVarExist);
         }
 
-        if (!Node::get().can_read(name, query))
-            Node::get().whisper<Observe>(name, query, output);
+        // macros call this in a loop, so only ask again if we aren't observing yet or want another rate. The observed peer
+        // hands back the same group with the new rate applied.
+        if (!Node::get().can_read(name, query) || !Node::get().observing_at(name, query, rate, heartbeat))
+            Node::get().whisper<Observe>(name, query, output, rate, heartbeat);
     }
 }
 
@@ -3142,14 +5660,8 @@ PLUGIN_API VOID DQueryCommand(PSPAWNINFO pSpawn, PCHAR szLine) {
         WriteChatColor("Syntax: /dquery <name> [-q <query>] [-o <result>] [-t <timeout>] -- execute query on name and store return in result", USERCOLOR_DEFAULT);
     } else if (name == Node::get().name()) {
         // this is a self-query, let's just return the evaluation of the query
-        MQTypeVar Result = Node::get().parse_response(output, Node::get().parse_query(query).c_str());
-        CHAR szBuf[MAX_STRING] = { 0 };
-        if (Result.Type)
-            Result.Type->ToString(Result.VarPtr, szBuf);
-        else
-            strcpy_s(szBuf, "NULL");
-
-        Node::get().query_result(name, query, Node::Observation(output, std::string(szBuf), MQGetTickCount64()));
+        const Node::stored_response result = Node::get().parse_response(output, Node::get().parse_query(query));
+        Node::get().query_result(name, query, Node::Observation(output, result.value, Node::get().client().tick()));
     } else {
         // reset the result so we can tell when we get a response. Needs to be done before the delay call.
         Node::get().query_result(name, query, Node::Observation(output));
@@ -3189,6 +5701,14 @@ PLUGIN_API VOID InitializePlugin() {
     Node::get().register_command<MQ2DanNet::Observe>();
     Node::get().register_command<MQ2DanNet::Update>();
     Node::get().register_command<MQ2DanNet::Reupdate>();
+    Node::get().register_command<MQ2DanNet::Updates>();
+    Node::get().register_command<MQ2DanNet::Resync>();
+    Node::get().register_command<MQ2DanNet::Probe>();
+
+    Node::get().register_decoder<MQ2DanNet::Echo>(decode_echo);
+    Node::get().register_decoder<MQ2DanNet::Execute>(decode_execute);
+    Node::get().register_decoder<MQ2DanNet::Update>(decode_update);
+    Node::get().register_decoder<MQ2DanNet::Updates>(decode_updates);
 
     Node::get().debugging(ReadBool("General", "Debugging"));
     Node::get().local_echo(ReadBool("General", "Local Echo"));
@@ -3206,6 +5726,14 @@ PLUGIN_API VOID InitializePlugin() {
         Node::get().observe_delay(GetIntFromString(GetDefault("Observe Delay").c_str(), 0));
     }
 
+    CHAR drain_budget[MAX_STRING] = { 0 };
+    strcpy_s(drain_budget, ReadVar("Drain Budget").c_str());
+    if (IsNumber(drain_budget)) {
+        Node::get().drain_budget(GetIntFromString(drain_budget, 0));
+    } else {
+        Node::get().drain_budget(GetIntFromString(GetDefault("Drain Budget").c_str(), 0));
+    }
+
     CHAR evasive[MAX_STRING] = { 0 };
     strcpy_s(evasive, ReadVar("Evasive").c_str());
     if (IsNumber(evasive)) {
@@ -3269,6 +5797,14 @@ PLUGIN_API VOID ShutdownPlugin() {
     Node::get().unregister_command<MQ2DanNet::Observe>();
     Node::get().unregister_command<MQ2DanNet::Update>();
     Node::get().unregister_command<MQ2DanNet::Reupdate>();
+    Node::get().unregister_command<MQ2DanNet::Updates>();
+    Node::get().unregister_command<MQ2DanNet::Resync>();
+    Node::get().unregister_command<MQ2DanNet::Probe>();
+
+    Node::get().unregister_decoder<MQ2DanNet::Echo>();
+    Node::get().unregister_decoder<MQ2DanNet::Execute>();
+    Node::get().unregister_decoder<MQ2DanNet::Update>();
+    Node::get().unregister_decoder<MQ2DanNet::Updates>();
 
     RemoveCommand("/dnet");
     RemoveCommand("/djoin");
@@ -3428,9 +5964,12 @@ PLUGIN_API VOID OnPulse() {
             Node::get().forget_if(DoesVarExist);
         }
 
-        Node::get().do_next();
-        Node::get().publish<Update>();
+        Node::get().drain();
+        Node::get().publish_updates();
+        Node::get().probe_peers();
     }
 }
 
 #pragma endregion
+
+#endif
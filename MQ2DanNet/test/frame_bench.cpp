@@ -0,0 +1,90 @@
+/* MQ2DanNet frame bench -- handing an outbound body to czmq, pooled frame_buffer against the stringstream it replaced
+ *
+ *   frame_bench [messages]
+ *
+ * The old path serialized into a stringstream, read that out into a new char[] and had zframe_new copy it again. Now
+ * pack() writes into pooled storage and zframe_frommem takes it over, so nothing is copied once the body is written.
+ * Both sides write the same two fields (group, result), length prefixed the way v1 did it, so the difference is what
+ * happens to the bytes afterwards.
+ */
+
+#include "test_node.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+using bench_clock = std::chrono::steady_clock;
+
+struct path_stats final {
+    double ns = 0;
+    unsigned __int64 copied = 0; // after serializing
+};
+
+static void write_field(std::stringstream& stream, const std::string& value) {
+    const uint32_t len = static_cast<uint32_t>(value.size());
+    const char len_buf[4] = { static_cast<char>(len >> 24), static_cast<char>(len >> 16), static_cast<char>(len >> 8), static_cast<char>(len) };
+    stream.write(len_buf, sizeof(len_buf));
+    stream.write(value.data(), value.size());
+}
+
+// what Node::publish did before frame_buffer
+static path_stats stringstream_path(size_t count, const std::string& group, const std::string& result) {
+    path_stats stats;
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        std::stringstream args;
+        write_field(args, group);
+        write_field(args, result);
+
+        args.seekg(0, args.end);
+        const size_t args_size = static_cast<size_t>(args.tellg());
+        args.seekg(0, args.beg);
+
+        char* args_buf = new char[args_size];
+        args.read(args_buf, args_size);
+        zframe_t* frame = zframe_new(args_buf, args_size);
+        delete[] args_buf;
+        stats.copied += 2 * args_size;
+
+        zframe_destroy(&frame);
+    }
+
+    stats.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+    return stats;
+}
+
+static path_stats frame_buffer_path(size_t count, const std::string& group, const std::string& result) {
+    path_stats stats;
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        frame_buffer args(wire_v1);
+        args << group << result;
+        const char* written = args.data();
+        zframe_t* frame = args.to_frame();
+        if (zframe_data(frame) != reinterpret_cast<const byte*>(written))
+            stats.copied += zframe_size(frame);
+
+        zframe_destroy(&frame);
+    }
+
+    stats.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+    return stats;
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::max(1, atoi(argv[1])) : 200000;
+
+    const std::string group = "test_bench_12";
+    for (size_t size : { 3, 64, 1024, 16384 }) {
+        const std::string result(size, '7');
+        const path_stats before = stringstream_path(count, group, result);
+        const path_stats after = frame_buffer_path(count, group, result);
+        printf("%6zu byte result: stringstream %8.1f ns, %6.0f bytes copied | frame_buffer %8.1f ns, %6.0f bytes copied\n", size,
+               before.ns, static_cast<double>(before.copied) / count, after.ns, static_cast<double>(after.copied) / count);
+    }
+
+    const frame_buffer::stats pool = frame_buffer::pool_stats();
+    printf("pool: %llu buffers acquired, %llu reused\n", static_cast<unsigned long long>(pool.acquired), static_cast<unsigned long long>(pool.reused));
+    return 0;
+}
@@ -0,0 +1,110 @@
+/* MQ2DanNet tests -- just enough of a runner to not need a test framework
+ *
+ * Each test binary is one translation unit (it includes MQ2DanNet.cpp), so this brings its own main. Run a binary with
+ * a name fragment to only run the tests whose names contain it.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace harness {
+struct test_case final {
+    const char* name;
+    void (*run)();
+};
+
+inline std::vector<test_case>& tests() {
+    static std::vector<test_case> instance;
+    return instance;
+}
+
+struct registrar final {
+    registrar(const char* name, void (*run)()) { tests().push_back(test_case{ name, run }); }
+};
+
+// thrown by a failed check, so a test stops at its first failure
+struct failure final {
+    std::string what;
+};
+
+inline std::string where(const char* file, int line) {
+    return std::string(file) + ":" + std::to_string(line) + ": ";
+}
+
+template <typename T>
+std::string show(const T& value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+inline std::string show(unsigned char value) { return std::to_string(static_cast<unsigned int>(value)); }
+inline std::string show(signed char value) { return std::to_string(static_cast<int>(value)); }
+inline std::string show(bool value) { return value ? "true" : "false"; }
+inline std::string show(const std::string& value) { return "\"" + value + "\""; }
+inline std::string show(const char* value) { return value ? "\"" + std::string(value) + "\"" : "null"; }
+}
+
+#define TEST(name)                                                                  \
+    static void test_##name();                                                      \
+    static const harness::registrar registrar_##name(#name, &test_##name);          \
+    static void test_##name()
+
+#define CHECK(expr)                                                                 \
+    do {                                                                            \
+        if (!(expr))                                                                \
+            throw harness::failure{ harness::where(__FILE__, __LINE__) + #expr };   \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                  \
+    do {                                                                            \
+        const auto& actual_ = (actual);                                             \
+        const auto& expected_ = (expected);                                         \
+        if (!(actual_ == expected_))                                                \
+            throw harness::failure{ harness::where(__FILE__, __LINE__) + #actual " == " #expected \
+                + " (got " + harness::show(actual_) + ", wanted " + harness::show(expected_) + ")" }; \
+    } while (0)
+
+#define CHECK_THROWS(expr, type)                                                    \
+    do {                                                                            \
+        bool thrown_ = false;                                                       \
+        try {                                                                       \
+            (void)(expr);                                                           \
+        } catch (type&) {                                                           \
+            thrown_ = true;                                                         \
+        }                                                                           \
+        if (!thrown_)                                                               \
+            throw harness::failure{ harness::where(__FILE__, __LINE__) + #expr " didn't throw " #type }; \
+    } while (0)
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    size_t ran = 0;
+    size_t failed = 0;
+    for (auto& test : harness::tests()) {
+        if (filter && !strstr(test.name, filter))
+            continue;
+
+        ++ran;
+        try {
+            test.run();
+            printf("ok   %s\n", test.name);
+        } catch (harness::failure& f) {
+            ++failed;
+            printf("FAIL %s\n     %s\n", test.name, f.what.c_str());
+        } catch (std::exception& e) {
+            ++failed;
+            printf("FAIL %s\n     threw %s\n", test.name, e.what());
+        }
+    }
+
+    printf("%zu of %zu passed\n", ran - failed, ran);
+    return failed == 0 && ran > 0 ? 0 : 1;
+}
@@ -0,0 +1,754 @@
+/* MQ2DanNet loopback -- see zyre.h
+ */
+
+#include "zyre.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one lock and one wakeup for the whole bus. Pollers wait on several sockets at once, and this is only ever carrying
+// test traffic, so a single condition variable is simpler than wiring up per-socket notification
+static std::mutex& bus_mutex() {
+    static std::mutex instance;
+    return instance;
+}
+
+static std::condition_variable& bus_ready() {
+    static std::condition_variable instance;
+    return instance;
+}
+
+struct _zframe_t {
+    std::vector<byte> copy;
+    byte* data = nullptr;
+    size_t size = 0;
+    zframe_destructor_fn* destructor = nullptr;
+    void* hint = nullptr;
+};
+
+struct _zmsg_t {
+    std::list<zframe_t*> frames;
+    std::list<zframe_t*>::iterator cursor;
+};
+
+// one end of a pipe, or a zyre node's event socket (which nobody sends on). Sending on an end queues on its peer
+struct _zsock_t {
+    zsock_t* peer = nullptr;
+    std::deque<zmsg_t*> inbox;
+};
+
+struct _zactor_t {
+    zsock_t front; // ours
+    zsock_t back;  // the actor's
+    std::thread thread;
+};
+
+struct _zpoller_t {
+    std::vector<void*> readers;
+    bool expired = false;
+};
+
+struct _zlist_t {
+    std::vector<std::string> items;
+    size_t next = 0;
+};
+
+struct _ziflist_t {
+    size_t next = 0;
+};
+
+struct _zyre_t {
+    std::string uuid;
+    std::string name;
+    std::string address;
+    std::map<std::string, std::string> headers;
+    std::set<std::string> groups;
+    zsock_t events;
+    bool started = false;
+};
+
+struct _zyre_event_t {
+    std::string type;
+    std::string peer_uuid;
+    std::string peer_name;
+    std::string peer_addr;
+    std::string group;
+    std::map<std::string, std::string> headers;
+    zmsg_t* msg = nullptr;
+};
+
+// everything below that touches a socket, an actor or the bus holds bus_mutex
+static std::set<zactor_t*>& actors() {
+    static std::set<zactor_t*> instance;
+    return instance;
+}
+
+static std::map<std::string, zyre_t*>& peers() {
+    static std::map<std::string, zyre_t*> instance;
+    return instance;
+}
+
+static loopback_stats& stats() {
+    static loopback_stats instance{};
+    return instance;
+}
+
+// actors are passed around as sockets, the way czmq lets you
+static zsock_t* resolve(void* socket) {
+    zactor_t* actor = reinterpret_cast<zactor_t*>(socket);
+    if (actors().count(actor))
+        return &actor->front;
+
+    return reinterpret_cast<zsock_t*>(socket);
+}
+
+static char* duplicate(const std::string& str) {
+    char* copy = reinterpret_cast<char*>(malloc(str.size() + 1));
+    memcpy(copy, str.c_str(), str.size() + 1);
+    return copy;
+}
+
+int zmq_setsockopt(void*, int, const void*, size_t) {
+    return 0;
+}
+
+zframe_t* zframe_new(const void* data, size_t size) {
+    zframe_t* frame = new zframe_t();
+    if (data && size)
+        frame->copy.assign(reinterpret_cast<const byte*>(data), reinterpret_cast<const byte*>(data) + size);
+    frame->data = frame->copy.data();
+    frame->size = frame->copy.size();
+    return frame;
+}
+
+zframe_t* zframe_frommem(void* data, size_t size, zframe_destructor_fn destructor, void* hint) {
+    zframe_t* frame = new zframe_t();
+    frame->data = reinterpret_cast<byte*>(data);
+    frame->size = size;
+    frame->destructor = destructor;
+    frame->hint = hint;
+    return frame;
+}
+
+byte* zframe_data(zframe_t* self) {
+    return self ? self->data : nullptr;
+}
+
+size_t zframe_size(zframe_t* self) {
+    return self ? self->size : 0;
+}
+
+void zframe_destroy(zframe_t** self_p) {
+    if (!self_p || !*self_p)
+        return;
+
+    zframe_t* frame = *self_p;
+    if (frame->destructor)
+        frame->destructor(&frame->hint);
+    delete frame;
+    *self_p = nullptr;
+}
+
+zmsg_t* zmsg_new() {
+    zmsg_t* msg = new zmsg_t();
+    msg->cursor = msg->frames.end();
+    return msg;
+}
+
+void zmsg_destroy(zmsg_t** self_p) {
+    if (!self_p || !*self_p)
+        return;
+
+    for (zframe_t* frame : (*self_p)->frames)
+        zframe_destroy(&frame);
+    delete *self_p;
+    *self_p = nullptr;
+}
+
+size_t zmsg_size(zmsg_t* self) {
+    return self ? self->frames.size() : 0;
+}
+
+int zmsg_prepend(zmsg_t* self, zframe_t** frame_p) {
+    self->frames.push_front(*frame_p);
+    *frame_p = nullptr;
+    return 0;
+}
+
+int zmsg_append(zmsg_t* self, zframe_t** frame_p) {
+    self->frames.push_back(*frame_p);
+    *frame_p = nullptr;
+    return 0;
+}
+
+int zmsg_pushmem(zmsg_t* self, const void* data, size_t size) {
+    zframe_t* frame = zframe_new(data, size);
+    return zmsg_prepend(self, &frame);
+}
+
+int zmsg_addmem(zmsg_t* self, const void* data, size_t size) {
+    zframe_t* frame = zframe_new(data, size);
+    return zmsg_append(self, &frame);
+}
+
+int zmsg_pushstr(zmsg_t* self, const char* string) {
+    return zmsg_pushmem(self, string, strlen(string));
+}
+
+int zmsg_addstr(zmsg_t* self, const char* string) {
+    return zmsg_addmem(self, string, strlen(string));
+}
+
+zframe_t* zmsg_pop(zmsg_t* self) {
+    if (!self || self->frames.empty())
+        return nullptr;
+
+    zframe_t* frame = self->frames.front();
+    self->frames.pop_front();
+    self->cursor = self->frames.end();
+    return frame;
+}
+
+char* zmsg_popstr(zmsg_t* self) {
+    zframe_t* frame = zmsg_pop(self);
+    if (!frame)
+        return nullptr;
+
+    char* str = duplicate(std::string(reinterpret_cast<const char*>(frame->data), frame->size));
+    zframe_destroy(&frame);
+    return str;
+}
+
+zframe_t* zmsg_first(zmsg_t* self) {
+    self->cursor = self->frames.begin();
+    return self->cursor != self->frames.end() ? *self->cursor : nullptr;
+}
+
+zframe_t* zmsg_next(zmsg_t* self) {
+    if (self->cursor == self->frames.end() || ++self->cursor == self->frames.end())
+        return nullptr;
+
+    return *self->cursor;
+}
+
+void zmsg_remove(zmsg_t* self, zframe_t* frame) {
+    self->frames.remove(frame);
+    self->cursor = self->frames.end();
+}
+
+int zmsg_send(zmsg_t** self_p, void* dest) {
+    if (!self_p || !*self_p || !dest)
+        return -1;
+
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        zsock_t* sock = resolve(dest);
+        if (!sock->peer)
+            return -1;
+
+        sock->peer->inbox.push_back(*self_p);
+    }
+
+    *self_p = nullptr;
+    bus_ready().notify_all();
+    return 0;
+}
+
+zmsg_t* zmsg_recv(void* source) {
+    std::unique_lock<std::mutex> lock(bus_mutex());
+    zsock_t* sock = resolve(source);
+    bus_ready().wait(lock, [sock]() { return !sock->inbox.empty(); });
+
+    zmsg_t* msg = sock->inbox.front();
+    sock->inbox.pop_front();
+    return msg;
+}
+
+int zstr_send(void* dest, const char* string) {
+    zmsg_t* msg = zmsg_new();
+    zmsg_addstr(msg, string);
+    const int rc = zmsg_send(&msg, dest);
+    zmsg_destroy(&msg);
+    return rc;
+}
+
+void zstr_free(char** string_p) {
+    if (string_p && *string_p) {
+        free(*string_p);
+        *string_p = nullptr;
+    }
+}
+
+int zsock_signal(void* self, byte status) {
+    return zstr_send(self, status == 0 ? "$SIGNAL" : "$SIGNAL-1");
+}
+
+zactor_t* zactor_new(zactor_fn* task, void* args) {
+    zactor_t* actor = new zactor_t();
+    actor->front.peer = &actor->back;
+    actor->back.peer = &actor->front;
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        actors().insert(actor);
+    }
+
+    // like czmq, the actor signals once it's ready and once more after it's done
+    actor->thread = std::thread([actor, task, args]() {
+        task(&actor->back, args);
+        zsock_signal(&actor->back, 0);
+    });
+
+    zmsg_t* ready = zmsg_recv(actor);
+    zmsg_destroy(&ready);
+    return actor;
+}
+
+void zactor_destroy(zactor_t** self_p) {
+    if (!self_p || !*self_p)
+        return;
+
+    zactor_t* actor = *self_p;
+    zstr_send(actor, "$TERM");
+
+    // anything the actor still had to say to us is dropped, down to its last signal
+    for (bool done = false; !done;) {
+        zmsg_t* msg = zmsg_recv(actor);
+        zframe_t* frame = zmsg_first(msg);
+        done = frame && frame->size >= 7 && !memcmp(frame->data, "$SIGNAL", 7);
+        zmsg_destroy(&msg);
+    }
+    actor->thread.join();
+
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        actors().erase(actor);
+        for (zsock_t* sock : { &actor->front, &actor->back }) {
+            for (zmsg_t* msg : sock->inbox)
+                zmsg_destroy(&msg);
+        }
+    }
+
+    delete actor;
+    *self_p = nullptr;
+}
+
+zpoller_t* zpoller_new(void* reader, ...) {
+    zpoller_t* poller = new zpoller_t();
+
+    va_list args;
+    va_start(args, reader);
+    while (reader) {
+        poller->readers.push_back(reader);
+        reader = va_arg(args, void*);
+    }
+    va_end(args);
+
+    return poller;
+}
+
+void* zpoller_wait(zpoller_t* self, int timeout) {
+    std::unique_lock<std::mutex> lock(bus_mutex());
+    void* which = nullptr;
+    auto ready = [self, &which]() -> bool {
+        for (void* reader : self->readers) {
+            if (!resolve(reader)->inbox.empty()) {
+                which = reader;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    if (timeout < 0)
+        bus_ready().wait(lock, ready);
+    else
+        bus_ready().wait_for(lock, std::chrono::milliseconds(timeout), ready);
+
+    self->expired = which == nullptr;
+    return which;
+}
+
+bool zpoller_expired(zpoller_t* self) {
+    return self->expired;
+}
+
+bool zpoller_terminated(zpoller_t*) {
+    return false;
+}
+
+void zpoller_set_nonstop(zpoller_t*, bool) {}
+
+void zpoller_destroy(zpoller_t** self_p) {
+    if (self_p && *self_p) {
+        delete *self_p;
+        *self_p = nullptr;
+    }
+}
+
+void* zlist_first(zlist_t* self) {
+    self->next = 0;
+    return zlist_next(self);
+}
+
+void* zlist_next(zlist_t* self) {
+    if (self->next >= self->items.size())
+        return nullptr;
+
+    return const_cast<char*>(self->items[self->next++].c_str());
+}
+
+void zlist_destroy(zlist_t** self_p) {
+    if (self_p && *self_p) {
+        delete *self_p;
+        *self_p = nullptr;
+    }
+}
+
+void* zsys_init() {
+    return nullptr;
+}
+
+void zsys_shutdown() {}
+
+const char* zsys_interface() {
+    return "";
+}
+
+int zsys_ipv6() {
+    return 0;
+}
+
+// nothing on the bus needs time to settle
+void zclock_sleep(int) {}
+
+ziflist_t* ziflist_new() {
+    return new ziflist_t();
+}
+
+ziflist_t* ziflist_new_ipv6() {
+    return new ziflist_t();
+}
+
+const char* ziflist_first(ziflist_t* self) {
+    self->next = 0;
+    return ziflist_next(self);
+}
+
+const char* ziflist_next(ziflist_t* self) {
+    return self->next++ == 0 ? "lo" : nullptr;
+}
+
+const char* ziflist_address(ziflist_t*) {
+    return "127.0.0.1";
+}
+
+const char* ziflist_broadcast(ziflist_t*) {
+    return "127.255.255.255";
+}
+
+bool ziflist_is_ipv6(ziflist_t*) {
+    return false;
+}
+
+void ziflist_destroy(ziflist_t** self_p) {
+    if (self_p && *self_p) {
+        delete *self_p;
+        *self_p = nullptr;
+    }
+}
+
+// queues an event for one node, frames of a message (if any) are taken over. Called with bus_mutex held
+static void deliver(zyre_t* to, const zyre_t* from, const char* type, const std::string& group = std::string(), zmsg_t* msg = nullptr) {
+    zmsg_t* event = zmsg_new();
+    zmsg_addstr(event, type);
+    zmsg_addstr(event, from->uuid.c_str());
+    zmsg_addstr(event, from->name.c_str());
+    zmsg_addstr(event, group.c_str());
+    zmsg_addstr(event, from->address.c_str());
+
+    if (!strcmp(type, "ENTER")) {
+        for (auto& header : from->headers) {
+            zmsg_addstr(event, header.first.c_str());
+            zmsg_addstr(event, header.second.c_str());
+        }
+        ++stats().events;
+    } else if (msg) {
+        for (zframe_t* frame : msg->frames) {
+            stats().bytes += frame->size;
+            zmsg_addmem(event, frame->data, frame->size);
+        }
+        ++stats().messages;
+    } else {
+        ++stats().events;
+    }
+
+    to->events.inbox.push_back(event);
+}
+
+zyre_t* zyre_new(const char* name) {
+    static unsigned int next = 0;
+    std::scoped_lock<std::mutex> lock(bus_mutex());
+    zyre_t* node = new zyre_t();
+
+    char uuid[33] = { 0 };
+    snprintf(uuid, sizeof(uuid), "%032X", ++next);
+    node->uuid = uuid;
+    node->name = name ? name : uuid;
+    node->address = "tcp://127.0.0.1:" + std::to_string(49152 + next);
+    return node;
+}
+
+void zyre_destroy(zyre_t** self_p) {
+    if (!self_p || !*self_p)
+        return;
+
+    zyre_stop(*self_p);
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        for (zmsg_t* msg : (*self_p)->events.inbox)
+            zmsg_destroy(&msg);
+    }
+
+    delete *self_p;
+    *self_p = nullptr;
+}
+
+const char* zyre_uuid(zyre_t* self) {
+    return self->uuid.c_str();
+}
+
+const char* zyre_name(zyre_t* self) {
+    return self->name.c_str();
+}
+
+void zyre_set_header(zyre_t* self, const char* name, const char* format, ...) {
+    char value[256] = { 0 };
+    va_list args;
+    va_start(args, format);
+    vsnprintf(value, sizeof(value), format, args);
+    va_end(args);
+
+    std::scoped_lock<std::mutex> lock(bus_mutex());
+    self->headers[name] = value;
+}
+
+void zyre_set_interface(zyre_t*, const char*) {}
+void zyre_set_evasive_timeout(zyre_t*, int) {}
+void zyre_set_expired_timeout(zyre_t*, int) {}
+
+int zyre_start(zyre_t* self) {
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        if (self->started)
+            return 0;
+
+        // everyone meets everyone straight away, along with the groups they're already in
+        for (auto& [uuid, peer] : peers()) {
+            deliver(peer, self, "ENTER");
+            for (auto& group : self->groups)
+                deliver(peer, self, "JOIN", group);
+
+            deliver(self, peer, "ENTER");
+            for (auto& group : peer->groups)
+                deliver(self, peer, "JOIN", group);
+        }
+
+        peers()[self->uuid] = self;
+        self->started = true;
+    }
+
+    bus_ready().notify_all();
+    return 0;
+}
+
+void zyre_stop(zyre_t* self) {
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        if (!self->started)
+            return;
+
+        peers().erase(self->uuid);
+        self->started = false;
+        for (auto& [uuid, peer] : peers())
+            deliver(peer, self, "EXIT");
+    }
+
+    bus_ready().notify_all();
+}
+
+static int change_group(zyre_t* self, const char* group, bool join) {
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        const bool changed = join ? self->groups.insert(group).second : self->groups.erase(group) > 0;
+        if (!changed || !self->started)
+            return 0;
+
+        for (auto& [uuid, peer] : peers()) {
+            if (peer != self)
+                deliver(peer, self, join ? "JOIN" : "LEAVE", group);
+        }
+    }
+
+    bus_ready().notify_all();
+    return 0;
+}
+
+int zyre_join(zyre_t* self, const char* group) {
+    return change_group(self, group, true);
+}
+
+int zyre_leave(zyre_t* self, const char* group) {
+    return change_group(self, group, false);
+}
+
+int zyre_whisper(zyre_t* self, const char* peer, zmsg_t** msg_p) {
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        auto it = peers().find(peer);
+        if (self->started && it != peers().end())
+            deliver(it->second, self, "WHISPER", std::string(), *msg_p);
+    }
+
+    zmsg_destroy(msg_p);
+    bus_ready().notify_all();
+    return 0;
+}
+
+int zyre_shout(zyre_t* self, const char* group, zmsg_t** msg_p) {
+    {
+        std::scoped_lock<std::mutex> lock(bus_mutex());
+        if (self->started) {
+            for (auto& [uuid, peer] : peers()) {
+                if (peer != self && peer->groups.count(group))
+                    deliver(peer, self, "SHOUT", group, *msg_p);
+            }
+        }
+    }
+
+    zmsg_destroy(msg_p);
+    bus_ready().notify_all();
+    return 0;
+}
+
+zlist_t* zyre_peers(zyre_t* self) {
+    std::scoped_lock<std::mutex> lock(bus_mutex());
+    zlist_t* list = new zlist_t();
+    for (auto& [uuid, peer] : peers()) {
+        if (peer != self)
+            list->items.push_back(uuid);
+    }
+    return list;
+}
+
+zlist_t* zyre_own_groups(zyre_t* self) {
+    std::scoped_lock<std::mutex> lock(bus_mutex());
+    zlist_t* list = new zlist_t();
+    list->items.assign(self->groups.begin(), self->groups.end());
+    return list;
+}
+
+char* zyre_peer_header_value(zyre_t*, const char* peer, const char* name) {
+    std::scoped_lock<std::mutex> lock(bus_mutex());
+    auto it = peers().find(peer);
+    if (it == peers().end())
+        return nullptr;
+
+    auto header = it->second->headers.find(name);
+    return header != it->second->headers.end() ? duplicate(header->second) : nullptr;
+}
+
+zsock_t* zyre_socket(zyre_t* self) {
+    return &self->events;
+}
+
+zyre_event_t* zyre_event_new(zyre_t* node) {
+    zmsg_t* msg = zmsg_recv(&node->events);
+    zyre_event_t* event = new zyre_event_t();
+
+    auto pop = [msg]() -> std::string {
+        char* str = zmsg_popstr(msg);
+        std::string result(str ? str : "");
+        zstr_free(&str);
+        return result;
+    };
+
+    event->type = pop();
+    event->peer_uuid = pop();
+    event->peer_name = pop();
+    event->group = pop();
+    event->peer_addr = pop();
+
+    if (event->type == "ENTER") {
+        while (zmsg_size(msg) >= 2) {
+            std::string name = pop();
+            event->headers[name] = pop();
+        }
+        zmsg_destroy(&msg);
+    } else if (event->type == "WHISPER" || event->type == "SHOUT") {
+        event->msg = msg;
+    } else {
+        zmsg_destroy(&msg);
+    }
+
+    return event;
+}
+
+void zyre_event_destroy(zyre_event_t** self_p) {
+    if (!self_p || !*self_p)
+        return;
+
+    zmsg_destroy(&(*self_p)->msg);
+    delete *self_p;
+    *self_p = nullptr;
+}
+
+const char* zyre_event_type(zyre_event_t* self) {
+    return self->type.c_str();
+}
+
+const char* zyre_event_peer_uuid(zyre_event_t* self) {
+    return self->peer_uuid.c_str();
+}
+
+const char* zyre_event_peer_name(zyre_event_t* self) {
+    return self->peer_name.c_str();
+}
+
+const char* zyre_event_peer_addr(zyre_event_t* self) {
+    return self->peer_addr.c_str();
+}
+
+const char* zyre_event_group(zyre_event_t* self) {
+    return self->group.empty() ? nullptr : self->group.c_str();
+}
+
+const char* zyre_event_header(zyre_event_t* self, const char* name) {
+    auto it = self->headers.find(name);
+    return it != self->headers.end() ? it->second.c_str() : nullptr;
+}
+
+zhash_t* zyre_event_headers(zyre_event_t*) {
+    return nullptr;
+}
+
+zmsg_t* zyre_event_get_msg(zyre_event_t* self) {
+    zmsg_t* msg = self->msg;
+    self->msg = nullptr;
+    return msg;
+}
+
+loopback_stats loopback_get_stats() {
+    std::scoped_lock<std::mutex> lock(bus_mutex());
+    return stats();
+}
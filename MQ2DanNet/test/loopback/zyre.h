@@ -0,0 +1,132 @@
+/* MQ2DanNet loopback -- an in-process stand-in for the parts of czmq and zyre that MQ2DanNet uses
+ *
+ * Every node in the process sits on one bus. Discovery is instant (ENTER/JOIN go out as soon as a node starts or joins),
+ * messages are delivered in order between any two nodes, and nothing ever goes missing. That's enough to run real
+ * nodes against each other in a test without a network, it is not a model of how a real network misbehaves.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+typedef unsigned char byte;
+
+typedef struct _zsock_t zsock_t;
+typedef struct _zactor_t zactor_t;
+typedef struct _zframe_t zframe_t;
+typedef struct _zmsg_t zmsg_t;
+typedef struct _zlist_t zlist_t;
+typedef struct _zpoller_t zpoller_t;
+typedef struct _ziflist_t ziflist_t;
+typedef struct _zhash_t zhash_t;
+typedef struct _zyre_t zyre_t;
+typedef struct _zyre_event_t zyre_event_t;
+
+typedef void (zactor_fn)(zsock_t* pipe, void* args);
+typedef void (zframe_destructor_fn)(void** hint);
+
+#define streq(s1, s2) (!strcmp((s1), (s2)))
+
+#define ZMQ_RCVTIMEO 27
+int zmq_setsockopt(void* socket, int option, const void* value, size_t size);
+
+// actors and pipes
+zactor_t* zactor_new(zactor_fn* task, void* args);
+void zactor_destroy(zactor_t** self_p);
+int zsock_signal(void* self, byte status);
+
+zpoller_t* zpoller_new(void* reader, ...);
+void* zpoller_wait(zpoller_t* self, int timeout);
+bool zpoller_expired(zpoller_t* self);
+bool zpoller_terminated(zpoller_t* self);
+void zpoller_set_nonstop(zpoller_t* self, bool nonstop);
+void zpoller_destroy(zpoller_t** self_p);
+
+// frames and messages
+zframe_t* zframe_new(const void* data, size_t size);
+zframe_t* zframe_frommem(void* data, size_t size, zframe_destructor_fn destructor, void* hint);
+byte* zframe_data(zframe_t* self);
+size_t zframe_size(zframe_t* self);
+void zframe_destroy(zframe_t** self_p);
+
+zmsg_t* zmsg_new();
+void zmsg_destroy(zmsg_t** self_p);
+size_t zmsg_size(zmsg_t* self);
+int zmsg_prepend(zmsg_t* self, zframe_t** frame_p);
+int zmsg_append(zmsg_t* self, zframe_t** frame_p);
+int zmsg_pushmem(zmsg_t* self, const void* data, size_t size);
+int zmsg_addmem(zmsg_t* self, const void* data, size_t size);
+int zmsg_pushstr(zmsg_t* self, const char* string);
+int zmsg_addstr(zmsg_t* self, const char* string);
+zframe_t* zmsg_pop(zmsg_t* self);
+char* zmsg_popstr(zmsg_t* self);
+zframe_t* zmsg_first(zmsg_t* self);
+zframe_t* zmsg_next(zmsg_t* self);
+void zmsg_remove(zmsg_t* self, zframe_t* frame);
+int zmsg_send(zmsg_t** self_p, void* dest);
+zmsg_t* zmsg_recv(void* source);
+
+int zstr_send(void* dest, const char* string);
+void zstr_free(char** string_p);
+
+// lists handed out by zyre, the items belong to the list
+void* zlist_first(zlist_t* self);
+void* zlist_next(zlist_t* self);
+void zlist_destroy(zlist_t** self_p);
+
+// system, there is one interface and it's loopback
+void* zsys_init();
+void zsys_shutdown();
+const char* zsys_interface();
+int zsys_ipv6();
+void zclock_sleep(int msecs);
+
+ziflist_t* ziflist_new();
+ziflist_t* ziflist_new_ipv6();
+const char* ziflist_first(ziflist_t* self);
+const char* ziflist_next(ziflist_t* self);
+const char* ziflist_address(ziflist_t* self);
+const char* ziflist_broadcast(ziflist_t* self);
+bool ziflist_is_ipv6(ziflist_t* self);
+void ziflist_destroy(ziflist_t** self_p);
+
+// zyre
+zyre_t* zyre_new(const char* name);
+void zyre_destroy(zyre_t** self_p);
+const char* zyre_uuid(zyre_t* self);
+const char* zyre_name(zyre_t* self);
+void zyre_set_header(zyre_t* self, const char* name, const char* format, ...);
+void zyre_set_interface(zyre_t* self, const char* value);
+void zyre_set_evasive_timeout(zyre_t* self, int interval);
+void zyre_set_expired_timeout(zyre_t* self, int interval);
+int zyre_start(zyre_t* self);
+void zyre_stop(zyre_t* self);
+int zyre_join(zyre_t* self, const char* group);
+int zyre_leave(zyre_t* self, const char* group);
+int zyre_whisper(zyre_t* self, const char* peer, zmsg_t** msg_p);
+int zyre_shout(zyre_t* self, const char* group, zmsg_t** msg_p);
+zlist_t* zyre_peers(zyre_t* self);
+zlist_t* zyre_own_groups(zyre_t* self);
+char* zyre_peer_header_value(zyre_t* self, const char* peer, const char* name);
+zsock_t* zyre_socket(zyre_t* self);
+
+zyre_event_t* zyre_event_new(zyre_t* node);
+void zyre_event_destroy(zyre_event_t** self_p);
+const char* zyre_event_type(zyre_event_t* self);
+const char* zyre_event_peer_uuid(zyre_event_t* self);
+const char* zyre_event_peer_name(zyre_event_t* self);
+const char* zyre_event_peer_addr(zyre_event_t* self);
+const char* zyre_event_group(zyre_event_t* self);
+const char* zyre_event_header(zyre_event_t* self, const char* name);
+zhash_t* zyre_event_headers(zyre_event_t* self);
+zmsg_t* zyre_event_get_msg(zyre_event_t* self);
+
+// how much the bus has carried, for the bench
+struct loopback_stats {
+    unsigned long long messages; // whispers and shout deliveries
+    unsigned long long bytes;    // frame bytes in those
+    unsigned long long events;   // everything else (ENTER, JOIN, ...)
+};
+loopback_stats loopback_get_stats();
@@ -0,0 +1,116 @@
+/* MQ2DanNet loopback bench -- N nodes in one process, every node observing every other one
+ *
+ *   loopback_bench [nodes] [queries per peer] [seconds]
+ *
+ * Reports how long discovery and the observers take to converge, how much the nodes push through the bus while every
+ * observed value keeps changing, and how long the last change takes to reach everyone. The bus itself is free, so this
+ * is the cost of the nodes: their actors, the game thread pulses and the wire format.
+ */
+
+#include "test_node.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double ms_since(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const size_t node_count = argc > 1 ? std::max(2, atoi(argv[1])) : 8;
+    const size_t query_count = argc > 2 ? std::max(1, atoi(argv[2])) : 4;
+    const double seconds = argc > 3 ? atof(argv[3]) : 2.0;
+    const std::chrono::milliseconds timeout(std::max<long long>(10000, static_cast<long long>(node_count * node_count * query_count)));
+
+    std::vector<std::string> queries;
+    for (size_t q = 0; q < query_count; ++q)
+        queries.push_back("Bench.Value" + std::to_string(q));
+
+    cluster net;
+    auto start = bench_clock::now();
+    for (size_t n = 0; n < node_count; ++n) {
+        test_node& node = net.add("Node" + std::to_string(n));
+        node.node.observe_delay(10);
+        for (auto& query : queries)
+            node.client.values[query] = "0";
+    }
+
+    if (!net.until([&net]() { return net.converged(); }, timeout)) {
+        printf("discovery didn't converge\n");
+        return 1;
+    }
+    printf("nodes %zu, queries per peer %zu, observers %zu\n", node_count, query_count, node_count * (node_count - 1) * query_count);
+    printf("discovery converged in %.1f ms\n", ms_since(start));
+
+    auto& nodes = net.nodes();
+    start = bench_clock::now();
+    for (auto& observer : nodes) {
+        for (auto& observed : nodes) {
+            if (observer == observed)
+                continue;
+
+            for (auto& query : queries)
+                observer->node.whisper<MQ2DanNet::Observe>(observed->name(), query, std::string(), 10u, 0u);
+        }
+    }
+
+    // everyone can read everyone's value
+    auto reads = [&nodes, &queries](const std::string& value) {
+        for (auto& observer : nodes) {
+            for (auto& observed : nodes) {
+                if (observer == observed)
+                    continue;
+
+                for (auto& query : queries) {
+                    if (!observer->node.can_read(observed->name(), query) || observer->node.read(observed->name(), query)->data.str() != value)
+                        return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    if (!net.until([&reads]() { return reads("0"); }, timeout)) {
+        printf("observers didn't converge\n");
+        return 1;
+    }
+    printf("observers converged in %.1f ms\n", ms_since(start));
+
+    // every value changes on every pulse
+    const loopback_stats before = loopback_get_stats();
+    start = bench_clock::now();
+    size_t pulses = 0;
+    unsigned int value = 0;
+    while (ms_since(start) < seconds * 1000.0) {
+        ++value;
+        for (auto& node : nodes) {
+            for (auto& query : queries)
+                node->client.values[query] = std::to_string(value);
+        }
+
+        net.pulse();
+        ++pulses;
+    }
+    const double elapsed = ms_since(start) / 1000.0;
+    const loopback_stats after = loopback_get_stats();
+    printf("%zu pulses in %.2f s, %.0f pulses/s per node\n", pulses, elapsed, pulses / elapsed);
+    printf("%.0f messages/s, %.1f KB/s over the bus\n", (after.messages - before.messages) / elapsed, (after.bytes - before.bytes) / elapsed / 1024.0);
+
+    // and then the last one has to get everywhere
+    start = bench_clock::now();
+    const std::string last = std::to_string(++value);
+    for (auto& node : nodes) {
+        for (auto& query : queries)
+            node->client.values[query] = last;
+    }
+
+    if (!net.until([&reads, &last]() { return reads(last); }, timeout)) {
+        printf("last update didn't converge\n");
+        return 1;
+    }
+    printf("last update converged in %.1f ms\n", ms_since(start));
+
+    return 0;
+}
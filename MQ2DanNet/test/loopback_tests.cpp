@@ -0,0 +1,117 @@
+/* MQ2DanNet tests -- whole nodes talking to each other over loopback
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+TEST(nodes_find_each_other) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+
+    CHECK_EQ(alice.name(), std::string("test_alice"));
+    CHECK(net.until([&]() { return alice.node.get_peers().count(bob.name()) && bob.node.get_peers().count(alice.name()); }));
+    CHECK(net.until([&]() { return alice.node.get_group_peers("all").count(bob.name()) > 0; }));
+}
+
+TEST(exit_drops_the_peer) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.get_peers().count(bob.name()) > 0; }));
+
+    const std::string gone = bob.name();
+    net.remove(bob);
+    CHECK(net.until([&]() { return alice.node.get_peers().count(gone) == 0; }));
+    CHECK(alice.node.get_group_peers("all").count(gone) == 0);
+}
+
+TEST(execute_reaches_the_peer) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.get_peers().count(bob.name()) > 0; }));
+
+    alice.node.whisper<MQ2DanNet::Execute>(bob.name(), std::string("/sit"));
+    CHECK(net.until([&]() { return !bob.client.executed.empty(); }));
+    CHECK_EQ(bob.client.executed.front(), std::string("/sit"));
+}
+
+TEST(query_round_trip) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.get_peers().count(bob.name()) > 0; }));
+
+    bob.client.values["Me.PctHPs"] = "87";
+    alice.node.query_result(bob.name(), "Me.PctHPs", MQ2DanNet::Node::Observation(std::string()));
+    alice.node.whisper<MQ2DanNet::Query>(bob.name(), std::string("Me.PctHPs"));
+
+    CHECK(net.until([&]() { return alice.node.query(bob.name(), "Me.PctHPs")->received != 0; }));
+    CHECK_EQ(alice.node.query(bob.name(), "Me.PctHPs")->data.str(), std::string("87"));
+
+    // reads share the stored result rather than copying it
+    CHECK(alice.node.query(bob.name(), "Me.PctHPs") == alice.node.query(bob.name(), "Me.PctHPs"));
+    CHECK(alice.node.query() == alice.node.query(bob.name(), "Me.PctHPs"));
+}
+
+TEST(observer_follows_changes) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.get_peers().count(bob.name()) > 0; }));
+
+    bob.node.observe_delay(10);
+    bob.client.values["Me.PctHPs"] = "87";
+    alice.node.whisper<MQ2DanNet::Observe>(bob.name(), std::string("Me.PctHPs"), std::string(), 0u, 0u);
+
+    auto reads = [&](const std::string& value) {
+        return alice.node.can_read(bob.name(), "Me.PctHPs") && alice.node.read(bob.name(), "Me.PctHPs")->data.str() == value;
+    };
+
+    CHECK(net.until([&]() { return reads("87"); }));
+    CHECK_EQ(bob.node.observer_count(), static_cast<size_t>(1));
+
+    bob.client.values["Me.PctHPs"] = "50";
+    CHECK(net.until([&]() { return reads("50"); }));
+
+    alice.node.forget(bob.name(), "Me.PctHPs");
+    CHECK(!alice.node.can_read(bob.name(), "Me.PctHPs"));
+}
+
+// a peer that leaves and comes back under the same name is a new peer to zyre, and whispers follow it there
+TEST(whispers_follow_a_returning_peer) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node* bob = &net.add("Bob");
+    const std::string name = bob->name();
+    CHECK(net.until([&]() { return alice.node.has_peer(name); }));
+
+    net.remove(*bob);
+    CHECK(net.until([&]() { return !alice.node.has_peer(name); }));
+    alice.node.whisper<MQ2DanNet::Execute>(name, std::string("/sit"));
+
+    bob = &net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.has_peer(name); }));
+    alice.node.whisper<MQ2DanNet::Execute>(name, std::string("/stand"));
+    CHECK(net.until([&]() { return !bob->client.executed.empty(); }));
+    CHECK(bob->client.executed == std::vector<std::string>({ "/stand" }));
+}
+
+// probes go out once per probe_interval, so the first one that can reach bob may be a few seconds off
+TEST(probes_time_the_round_trip_until_exit) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    const std::string gone = bob.name();
+    CHECK(net.until([&]() { return alice.node.has_peer(gone); }));
+
+    MQ2DanNet::Node::peer_health health;
+    CHECK(net.until([&]() { return alice.node.health(gone, health) && health.probes > 0; }, std::chrono::milliseconds(7000)));
+    CHECK(health.rtt > 0);
+    CHECK(health.last_rtt > 0);
+
+    net.remove(bob);
+    CHECK(net.until([&]() { return !alice.node.has_peer(gone); }));
+    CHECK(!alice.node.health(gone, health));
+}
@@ -0,0 +1,132 @@
+/* MQ2DanNet tests -- peer and group membership as the actor publishes it
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+using names = std::set<std::string>;
+
+// alice, bob and carol, all in "all", with alice and bob also in raid and carol in pull
+struct grouped final {
+    cluster net;
+    test_node& alice;
+    test_node& bob;
+    test_node& carol;
+
+    grouped() : alice(net.add("Alice")), bob(net.add("Bob")), carol(net.add("Carol")) {
+        alice.node.join("raid");
+        bob.node.join("raid");
+        carol.node.join("pull");
+        if (!net.until([this]() { return net.converged() && alice.node.get_group_peers("pull").size() == 1 && alice.node.get_group_peers("raid").size() == 2; }))
+            throw harness::failure{ "groups never settled" };
+    }
+};
+
+TEST(groups_are_indexed_both_ways) {
+    grouped g;
+    CHECK(g.alice.node.get_peers() == names({ g.alice.name(), g.bob.name(), g.carol.name() }));
+    CHECK(g.alice.node.get_group_peers("raid") == names({ g.alice.name(), g.bob.name() }));
+    CHECK(g.alice.node.get_group_peers("pull") == names({ g.carol.name() }));
+    CHECK(g.alice.node.get_group_peers("all") == names({ g.alice.name(), g.bob.name(), g.carol.name() }));
+    CHECK(g.alice.node.get_group_peers("nowhere").empty());
+
+    CHECK(g.alice.node.get_peer_groups(g.bob.name()) == names({ "all", "raid" }));
+    CHECK(g.alice.node.get_peer_groups(g.carol.name()) == names({ "all", "pull" }));
+    CHECK(g.alice.node.get_peer_groups("test_nobody").empty());
+
+    CHECK(g.alice.node.get_own_groups() == names({ "all", "raid" }));
+    CHECK(g.alice.node.get_all_groups() == names({ "all", "pull", "raid" }));
+
+    const auto everyone = g.alice.node.get_group_peers();
+    CHECK_EQ(everyone.size(), static_cast<size_t>(3));
+    CHECK(everyone.at("raid") == names({ g.alice.name(), g.bob.name() }));
+}
+
+TEST(leaving_drops_only_that_group) {
+    grouped g;
+    g.bob.node.leave("raid");
+    CHECK(g.net.until([&g]() { return g.alice.node.get_group_peers("raid") == names({ g.alice.name() }); }));
+    CHECK(g.alice.node.get_peer_groups(g.bob.name()) == names({ "all" }));
+    CHECK(g.alice.node.has_peer(g.bob.name()));
+
+    // nobody left in it, so it isn't a group anymore
+    g.alice.node.leave("raid");
+    CHECK(g.net.until([&g]() { return g.alice.node.get_all_groups().count("raid") == 0; }));
+    CHECK(g.alice.node.get_own_groups() == names({ "all" }));
+    CHECK(!g.alice.node.is_in_group("raid"));
+}
+
+TEST(exit_drops_the_peer_from_every_group) {
+    grouped g;
+    const std::string carol = g.carol.name();
+    g.net.remove(g.carol);
+
+    CHECK(g.net.until([&g, &carol]() { return !g.alice.node.has_peer(carol); }));
+    CHECK(g.alice.node.get_peer_groups(carol).empty());
+    CHECK_EQ(g.alice.node.get_all_groups().count("pull"), static_cast<size_t>(0));
+    CHECK(g.alice.node.get_group_peers("all") == names({ g.alice.name(), g.bob.name() }));
+    CHECK(g.alice.node.get_group_peers("raid") == names({ g.alice.name(), g.bob.name() }));
+    CHECK_EQ(g.alice.node.peers(), static_cast<size_t>(2));
+}
+
+TEST(snapshots_never_change) {
+    grouped g;
+    const auto before = g.alice.node.snapshot();
+    const size_t raid = before->group_members("raid").size();
+
+    g.bob.node.join("late");
+    g.carol.node.join("raid");
+    CHECK(g.net.until([&g]() { return g.alice.node.get_group_peers("raid").size() == 3 && g.alice.node.get_all_groups().count("late") > 0; }));
+
+    const auto after = g.alice.node.snapshot();
+    CHECK(after->generation > before->generation);
+    CHECK_EQ(before->group_members("raid").size(), raid);
+    CHECK(before->group_members("late").empty());
+    CHECK_EQ(after->group_members("raid").size(), static_cast<size_t>(3));
+}
+
+TEST(shared_values_copy_on_first_edit) {
+    using shared = MQ2DanNet::Node::shared_value<std::set<int>>;
+    shared first;
+    first.edit().insert(1);
+
+    shared second = first;
+    CHECK(&*second == &*first);
+
+    std::set<int>& copy = second.edit();
+    CHECK(&copy != &*first);
+    copy.insert(2);
+    CHECK(&second.edit() == &copy); // already its own
+    CHECK(*first == std::set<int>({ 1 }));
+    CHECK(*second == std::set<int>({ 1, 2 }));
+}
+
+// a join copies the sets for that group and that peer, everything else is the last snapshot's
+TEST(snapshots_share_what_an_event_leaves_alone) {
+    grouped g;
+    const auto before = g.alice.node.snapshot();
+
+    g.bob.node.join("late");
+    CHECK(g.net.until([&g]() { return g.alice.node.get_all_groups().count("late") > 0; }));
+    const auto after = g.alice.node.snapshot();
+
+    CHECK(&after->group_members("raid") == &before->group_members("raid"));
+    CHECK(&after->group_members("pull") == &before->group_members("pull"));
+    CHECK(&after->groups_of(g.carol.name()) == &before->groups_of(g.carol.name()));
+    CHECK(&*after->peers == &*before->peers);
+    CHECK(&*after->addresses == &*before->addresses);
+    CHECK(&*after->names == &*before->names);
+    CHECK(&*after->own_groups == &*before->own_groups);
+
+    CHECK(&after->groups_of(g.bob.name()) != &before->groups_of(g.bob.name()));
+    CHECK(after->groups_of(g.bob.name()).size() == before->groups_of(g.bob.name()).size() + 1);
+    CHECK(&*after->groups != &*before->groups);
+}
+
+TEST(wire_versions_follow_membership) {
+    grouped g;
+    CHECK_EQ(g.alice.node.peer_wire_version(g.bob.name()), wire_version);
+    CHECK_EQ(g.alice.node.peer_wire_version("test_nobody"), wire_v1);
+    CHECK_EQ(g.alice.node.group_wire_version("raid"), wire_version);
+    CHECK_EQ(g.alice.node.group_wire_version("nowhere"), wire_version);
+}
@@ -0,0 +1,264 @@
+/* MQ2DanNet tests -- a stand-in for the parts of MQ's plugin API that MQ2DanNet.cpp uses, so the plugin half (the TLO
+ * and its types) builds and links off Windows. Nothing here does anything beyond what a test needs to look at: the data
+ * types remember which member was asked of them, and everything else is a no-op.
+ */
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _MSC_VER
+#define __int64 long long
+#endif
+
+#define PLUGIN_VERSION(x) static float MQ2Version = (float)(x)
+#define PreSetup(x) static char INIFileName[260] = x
+#define PLUGIN_API extern "C"
+
+typedef void VOID;
+typedef char CHAR;
+typedef char* PCHAR;
+typedef unsigned long DWORD;
+typedef uint64_t uint64;
+
+#define MAX_STRING 2048
+#define USERCOLOR_DEFAULT 0
+#define GAMESTATE_CHARSELECT 1
+#define GAMESTATE_INGAME 5
+#define GAMESTATE_LOGGINGIN 253
+#define GAMESTATE_UNLOADING 255
+#define ZeroMemory(p, n) memset(p, 0, n)
+
+template <size_t N>
+int strcpy_s(char (&dest)[N], const char* src) {
+    snprintf(dest, N, "%s", src);
+    return 0;
+}
+
+inline int strcpy_s(char* dest, size_t size, const char* src) {
+    snprintf(dest, size, "%s", src);
+    return 0;
+}
+
+template <size_t N>
+int strcat_s(char (&dest)[N], const char* src) {
+    strncat(dest, src, N - strlen(dest) - 1);
+    return 0;
+}
+
+inline int strcat_s(char* dest, size_t size, const char* src) {
+    strncat(dest, src, size - strlen(dest) - 1);
+    return 0;
+}
+
+template <size_t N>
+int sprintf_s(char (&dest)[N], const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int r = vsnprintf(dest, N, format, args);
+    va_end(args);
+    return r;
+}
+
+inline int sprintf_s(char* dest, size_t size, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int r = vsnprintf(dest, size, format, args);
+    va_end(args);
+    return r;
+}
+
+inline unsigned long GetPrivateProfileString(const char*, const char*, const char* def, char* out, unsigned long size, const char*) {
+    snprintf(out, size, "%s", def ? def : "");
+    return static_cast<unsigned long>(strlen(out));
+}
+
+inline int WritePrivateProfileStringA(const char*, const char*, const char*, const char*) { return 1; }
+
+inline void DebugSpewAlways(const char*, ...) {}
+inline void WriteChatf(const char*, ...) {}
+inline void WriteChatColor(const char*, int = 0) {}
+inline void MacroError(const char*, ...) {}
+inline void SyntaxError(const char*, ...) {}
+inline uint64_t MQGetTickCount64() { return 0; }
+inline bool ParseMacroData(char*, size_t) { return true; }
+inline bool IsNumber(const char* text) {
+    if (!text || !*text)
+        return false;
+    for (; *text; ++text) {
+        if (*text < '0' || *text > '9')
+            return false;
+    }
+    return true;
+}
+inline int GetIntFromString(const char* text, int def) { return text && *text ? atoi(text) : def; }
+inline int GetIntFromString(const std::string& text, int def) { return GetIntFromString(text.c_str(), def); }
+inline float GetFloatFromString(const char* text, float def) { return text && *text ? static_cast<float>(atof(text)) : def; }
+inline const char* GetArg(char* dest, const char*, int, bool = false, bool = false, bool = false, char = ' ', bool = false) {
+    dest[0] = '\0';
+    return dest;
+}
+inline bool ci_equals(const char* lhs, const char* rhs) { return strcasecmp(lhs, rhs) == 0; }
+inline void EzCommand(const char*) {}
+inline const char* GetServerShortName() { return "test"; }
+inline bool IsMainThread() { return true; }
+inline void PostToMainThread(std::function<void()> f) { f(); }
+
+inline int gParserVersion = 2;
+struct MQMacroBlock {};
+inline std::shared_ptr<MQMacroBlock> gMacroBlock;
+inline char DataTypeTemp[MAX_STRING];
+
+struct MQ2Type;
+
+struct MQVarPtr {
+    union {
+        void* Ptr;
+        float Float;
+        DWORD DWord;
+        int Int;
+        int64_t Int64;
+        uint64_t UInt64;
+        double Double;
+    };
+    DWORD HighPart;
+};
+
+// VarPtr is the same storage as the value, the way MQ lays it out (types are handed their own VarPtr back)
+struct MQTypeVar {
+    MQ2Type* Type;
+    union {
+        MQVarPtr VarPtr;
+        struct {
+            union {
+                void* Ptr;
+                float Float;
+                DWORD DWord;
+                int Int;
+                int64_t Int64;
+                uint64_t UInt64;
+                double Double;
+                bool Set;
+            };
+            DWORD HighPart;
+        };
+    };
+};
+
+using MQ2TypeVar = MQTypeVar;
+
+struct MQTypeMember {
+    int ID;
+    const char* Name;
+};
+
+struct MQ2Type {
+    explicit MQ2Type(const char* name) : _name(name) {}
+    virtual ~MQ2Type() = default;
+
+    MQTypeMember* FindMember(const char* name) {
+        for (auto& member : _members) {
+            if (ci_equals(member.Name, name))
+                return &member;
+        }
+        return nullptr;
+    }
+
+    void AddMember(int id, const char* name) { _members.push_back(MQTypeMember{ id, name }); }
+    const char* GetName() { return _name; }
+
+    virtual bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) = 0;
+    virtual bool ToString(MQVarPtr, char*) { return false; }
+    virtual void InitVariable(MQVarPtr&) {}
+    virtual void FreeVariable(MQVarPtr&) {}
+    virtual bool FromData(MQVarPtr&, const MQTypeVar&) { return false; }
+    virtual bool FromString(MQVarPtr&, const char*) { return false; }
+
+private:
+    const char* _name;
+    std::vector<MQTypeMember> _members;
+};
+
+#define TypeMember(x) AddMember(x, #x)
+
+// MQ's own types, as far as the tests care: each one remembers the last member it was asked for and what it was asked
+// of, and answers every member
+struct stand_in_type final : public MQ2Type {
+    explicit stand_in_type(const char* name) : MQ2Type(name) {}
+
+    std::string member;
+    MQVarPtr asked{};
+
+    bool GetMember(MQVarPtr VarPtr, const char* Member, char*, MQTypeVar& Dest) override {
+        member = Member;
+        asked = VarPtr;
+        Dest.Type = this;
+        Dest.VarPtr = VarPtr;
+        return true;
+    }
+};
+
+namespace mq {
+namespace datatypes {
+inline stand_in_type string_type("string"), int_type("int"), int64_type("int64"), bool_type("bool"), float_type("float"), double_type("double");
+inline MQ2Type *pStringType = &string_type, *pIntType = &int_type, *pInt64Type = &int64_type, *pBoolType = &bool_type,
+               *pFloatType = &float_type, *pDoubleType = &double_type;
+} // namespace datatypes
+} // namespace mq
+
+struct MQDataVar {
+    MQTypeVar Var;
+};
+inline MQDataVar* FindMQ2DataVariable(const char*) { return nullptr; }
+
+struct SPAWNINFO {
+    struct {
+        int Class;
+    } mActorClient;
+};
+typedef SPAWNINFO* PSPAWNINFO;
+
+struct GROUPMEMBER {
+    char Name[64];
+};
+struct GROUPINFO {
+    GROUPMEMBER* pLeader;
+};
+struct CHARINFO {
+    char Name[64];
+    PSPAWNINFO pSpawn;
+    GROUPINFO* pGroupInfo;
+};
+typedef CHARINFO* PCHARINFO;
+
+inline PCHARINFO GetCharInfo() { return nullptr; }
+inline int GetGameState() { return GAMESTATE_CHARSELECT; }
+inline void Delay(PSPAWNINFO, const char*) {}
+
+struct EQ {
+    const char* GetClassThreeLetterCode(int) { return "WAR"; }
+};
+inline EQ* pEverQuest = nullptr;
+
+struct RAID {
+    char RaidLeaderName[64];
+};
+inline RAID* pRaid = nullptr;
+
+struct ZONEINFO {
+    char ShortName[64];
+};
+typedef ZONEINFO* PZONEINFO;
+inline void* pZoneInfo = nullptr;
+
+inline void AddCommand(const char*, void (*)(PSPAWNINFO, PCHAR)) {}
+inline void RemoveCommand(const char*) {}
+inline void AddMQ2Data(const char*, bool (*)(const char*, MQTypeVar&)) {}
+inline void RemoveMQ2Data(const char*) {}
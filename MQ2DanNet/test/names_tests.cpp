@@ -0,0 +1,206 @@
+/* MQ2DanNet tests -- the interned name table, that the node gives names back once it's done with them, and the
+ * canonical names it caches for the game thread
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+using MQ2DanNet::name_ref;
+using MQ2DanNet::name_table;
+
+TEST(names_intern_to_one_id) {
+    name_ref first = name_table::get().intern("names_intern_to_one_id");
+    name_ref second = name_table::get().intern("names_intern_to_one_id");
+    CHECK(first);
+    CHECK(first == second);
+    CHECK(first.id() != 0u);
+    CHECK_EQ(first.str(), std::string("names_intern_to_one_id"));
+    CHECK(name_table::get().find("names_intern_to_one_id") == first);
+    CHECK(name_table::get().intern("names_intern_to_one_id_too") != first);
+}
+
+TEST(find_never_adds) {
+    const size_t size = name_table::get().size();
+    name_ref missing = name_table::get().find("find_never_adds");
+    CHECK(!missing);
+    CHECK_EQ(missing.id(), 0u);
+    CHECK(missing.str().empty());
+    CHECK_EQ(name_table::get().size(), size);
+}
+
+TEST(the_last_ref_drops_the_name) {
+    const size_t size = name_table::get().size();
+    const unsigned __int64 dropped = name_table::get().dropped();
+
+    name_ref held = name_table::get().intern("the_last_ref_drops_the_name");
+    {
+        name_ref copy = held;
+        name_ref moved = std::move(copy);
+        CHECK(!copy);
+        CHECK(moved == held);
+    }
+
+    CHECK_EQ(name_table::get().size(), size + 1);
+    CHECK(name_table::get().find("the_last_ref_drops_the_name"));
+
+    held.reset();
+    CHECK(!held);
+    CHECK_EQ(name_table::get().size(), size);
+    CHECK_EQ(name_table::get().dropped(), dropped + 1);
+    CHECK(!name_table::get().find("the_last_ref_drops_the_name"));
+}
+
+TEST(dropped_ids_are_handed_out_again) {
+    name_ref gone = name_table::get().intern("dropped_ids_are_handed_out_again");
+    const MQ2DanNet::name_id id = gone.id();
+    gone.reset();
+
+    name_ref next = name_table::get().intern("dropped_ids_are_handed_out_again_next");
+    CHECK_EQ(next.id(), id);
+    CHECK_EQ(next.str(), std::string("dropped_ids_are_handed_out_again_next"));
+}
+
+TEST(refs_cross_threads) {
+    const size_t size = name_table::get().size();
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([]() {
+                for (int i = 0; i < 20000; ++i) {
+                    name_ref ref = name_table::get().intern("refs_cross_threads_" + std::to_string(i % 8));
+                    name_ref copy = ref;
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    CHECK_EQ(name_table::get().size(), size);
+}
+
+// what the node holds on to comes back out of the table once it lets go
+TEST(answered_queries_give_their_names_back) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.has_peer(bob.name()); }));
+
+    bob.client.values["Me.PctHPs"] = "87";
+    alice.node.query_result(bob.name(), "Me.PctHPs", MQ2DanNet::Node::Observation(std::string()));
+    alice.node.whisper<MQ2DanNet::Query>(bob.name(), std::string("Me.PctHPs"));
+    CHECK(name_table::get().find("response_0"));
+    CHECK(net.until([&]() { return alice.node.query(bob.name(), "Me.PctHPs")->received != 0; }));
+
+    // the response handler is gone, so its name is too
+    CHECK(!name_table::get().find("response_0"));
+}
+
+TEST(forgotten_observers_give_their_names_back) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.has_peer(bob.name()); }));
+
+    bob.client.values["Me.Unique.Query.Text"] = "1";
+    alice.node.whisper<MQ2DanNet::Observe>(bob.name(), std::string("Me.Unique.Query.Text"), std::string(), 0u, 0u);
+    CHECK(net.until([&]() { return alice.node.can_read(bob.name(), "Me.Unique.Query.Text"); }));
+    CHECK(name_table::get().find("Me.Unique.Query.Text"));
+
+    alice.node.forget(bob.name(), "Me.Unique.Query.Text");
+    bob.node.unregister_observer("Me.Unique.Query.Text");
+    CHECK(!name_table::get().find("Me.Unique.Query.Text"));
+}
+
+TEST(old_query_results_are_dropped) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+
+    for (int i = 0; i < 300; ++i)
+        alice.node.query_result("test_bob", "Query." + std::to_string(i), MQ2DanNet::Node::Observation(std::string(), std::string("1"), 1000 + i));
+
+    CHECK_EQ(alice.node.query("test_bob", "Query.299")->received, 1299ull);
+    CHECK_EQ(alice.node.query("test_bob", "Query.0")->received, 0ull);
+    CHECK(!name_table::get().find("Query.0"));
+}
+
+// the count in front of marker on the names stats line, the first half of "cached/limit" or "hits/lookups"
+static unsigned __int64 name_stat(MQ2DanNet::Node& node, const std::string& marker) {
+    for (const std::string& line : node.get_stats()) {
+        const size_t end = line.find(marker);
+        if (end == std::string::npos || line.find("canonical cached") == std::string::npos)
+            continue;
+
+        const size_t begin = line.rfind(' ', end - 1) + 1;
+        return std::stoull(line.substr(begin, end - begin));
+    }
+
+    throw harness::failure{ "no " + marker + " on the names stats line" };
+}
+
+TEST(both_name_forms) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+
+    CHECK_EQ(alice.node.get_full_name("Bob"), std::string("test_bob"));
+    CHECK_EQ(alice.node.get_full_name("Test_Bob"), std::string("test_bob"));
+    CHECK_EQ(alice.node.get_full_name("other_bob"), std::string("other_bob"));
+
+    CHECK_EQ(alice.node.get_short_name("Bob"), std::string("bob"));
+    CHECK_EQ(alice.node.get_short_name("Test_Bob"), std::string("bob"));
+    CHECK_EQ(alice.node.get_short_name("other_bob"), std::string("other_bob"));
+
+    // only the whole server name followed by an underscore counts, not any of its letters
+    CHECK_EQ(alice.node.get_short_name("set_bob"), std::string("set_bob"));
+    CHECK_EQ(alice.node.get_short_name("testing_bob"), std::string("testing_bob"));
+}
+
+TEST(canonical_names_are_cached) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    const unsigned __int64 hits = name_stat(alice.node, " hits");
+    const unsigned __int64 cached = name_stat(alice.node, " canonical cached");
+
+    CHECK_EQ(alice.node.get_full_name("Carol"), std::string("test_carol"));
+    CHECK_EQ(name_stat(alice.node, " canonical cached"), cached + 1);
+    CHECK_EQ(alice.node.get_short_name("Carol"), std::string("carol"));
+    CHECK_EQ(alice.node.get_full_name("Carol"), std::string("test_carol"));
+    CHECK_EQ(name_stat(alice.node, " canonical cached"), cached + 1);
+    CHECK(name_stat(alice.node, " hits") >= hits + 2);
+}
+
+TEST(a_full_name_cache_starts_over) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    const unsigned __int64 full = name_stat(alice.node, " times full");
+
+    for (int i = 0; name_stat(alice.node, " canonical cached") < 1024; ++i)
+        alice.node.get_full_name("Filler" + std::to_string(i));
+    CHECK_EQ(name_stat(alice.node, " times full"), full);
+
+    CHECK_EQ(alice.node.get_full_name("Dave"), std::string("test_dave"));
+    CHECK_EQ(name_stat(alice.node, " times full"), full + 1);
+    CHECK_EQ(name_stat(alice.node, " canonical cached"), 1ull);
+}
+
+TEST(a_new_server_drops_the_cache) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    CHECK_EQ(alice.node.get_full_name("Bob"), std::string("test_bob"));
+    CHECK_EQ(name_stat(alice.node, " server changes"), 0ull);
+
+    alice.node.exit();
+    alice.client.server = "Other";
+    alice.node.enter();
+    CHECK_EQ(name_stat(alice.node, " server changes"), 1ull);
+    CHECK_EQ(alice.name(), std::string("other_alice"));
+    CHECK_EQ(alice.node.get_full_name("Bob"), std::string("other_bob"));
+    CHECK_EQ(alice.node.get_short_name("other_bob"), std::string("bob"));
+    CHECK_EQ(alice.node.get_short_name("test_bob"), std::string("test_bob"));
+
+    // the same server again keeps what's cached
+    alice.node.exit();
+    alice.node.enter();
+    CHECK_EQ(name_stat(alice.node, " server changes"), 1ull);
+}
@@ -0,0 +1,369 @@
+/* MQ2DanNet tests -- observer results: batching into Updates, deltas, sequences and resyncs
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+using MQ2DanNet::Node;
+
+// an observer on bob's query, as alice holds it, with bob's Resync handler swapped out so the test can see what
+// alice asks for again
+struct observing final {
+    static constexpr const char* query = "Me.PctHPs";
+
+    cluster net;
+    test_node& alice;
+    test_node& bob;
+    std::string group;
+    std::vector<std::string> resyncs;
+    unsigned __int64 serial = 0;
+
+    observing() : alice(net.add("Alice")), bob(net.add("Bob")) {
+        if (!net.until([this]() { return alice.node.get_peers().count(bob.name()) > 0; }))
+            throw harness::failure{ "peers never met" };
+
+        group = bob.name() + "_7";
+        alice.node.observe(group, bob.name(), query);
+
+        bob.node.register_command(Node::name<MQ2DanNet::Resync>(), [this](const MQ2DanNet::message& args) -> bool {
+            frame_reader reader = args.reader();
+            while (!reader.empty())
+                resyncs.push_back(std::get<0>(MQ2DanNet::Resync::body::decode(reader)));
+            return false;
+        });
+    }
+
+    // bob's next batch, as if it came off the wire
+    size_t deliver(unsigned __int64 sequence, const std::string& result, const std::string& previous = std::string()) {
+        std::map<std::string, MQ2DanNet::update_record> records;
+        records[group] = MQ2DanNet::update_record{ result, previous, sequence };
+
+        frame_buffer frame = alice.node.pack<MQ2DanNet::Updates>(wire_v3, alice.name(), ++serial, records);
+        const size_t size = frame.size();
+        MQ2DanNet::message args(alice.node, bob.name(), std::string(), std::move(frame));
+        MQ2DanNet::Updates::callback(args);
+        return size;
+    }
+
+    std::string value() {
+        return alice.node.can_read(bob.name(), query) ? alice.node.read(bob.name(), query)->data.str() : std::string("<none>");
+    }
+
+    unsigned __int64 sequence() {
+        observed_value last;
+        return alice.node.last_sequence(group, last);
+    }
+};
+
+TEST(updates_apply_full_results) {
+    observing o;
+    o.deliver(1, "100");
+    CHECK_EQ(o.value(), std::string("100"));
+    CHECK_EQ(o.sequence(), 1ull);
+
+    o.deliver(2, "Fippy Darkpaw");
+    CHECK_EQ(o.value(), std::string("Fippy Darkpaw"));
+
+    o.deliver(3, "NULL");
+    CHECK_EQ(o.value(), std::string("NULL"));
+
+    o.deliver(4, "TRUE");
+    CHECK_EQ(o.value(), std::string("TRUE"));
+    CHECK(o.resyncs.empty());
+}
+
+TEST(updates_apply_deltas_in_order) {
+    observing o;
+    o.deliver(1, "100");
+
+    const size_t delta = o.deliver(2, "97", "100");
+    CHECK_EQ(o.value(), std::string("97"));
+    CHECK_EQ(o.sequence(), 2ull);
+
+    const size_t full = o.deliver(3, "1234567", "");
+    CHECK(delta < full);
+    CHECK_EQ(o.value(), std::string("1234567"));
+
+    o.deliver(4, "1234500", "1234567");
+    CHECK_EQ(o.value(), std::string("1234500"));
+    CHECK(o.resyncs.empty());
+}
+
+TEST(updates_keep_decimal_places) {
+    observing o;
+    o.deliver(1, "12.50");
+    CHECK_EQ(o.value(), std::string("12.50"));
+
+    o.deliver(2, "-0.25", "12.50");
+    CHECK_EQ(o.value(), std::string("-0.25"));
+
+    // different places can't be a delta, so this goes out in full
+    o.deliver(3, "7.125", "-0.25");
+    CHECK_EQ(o.value(), std::string("7.125"));
+    CHECK(o.resyncs.empty());
+}
+
+TEST(updates_resync_a_gap) {
+    observing o;
+    o.deliver(1, "100");
+    o.deliver(2, "97", "100");
+
+    // 3 never arrived, so 4 has nothing to apply on top of
+    o.deliver(4, "90", "95");
+    CHECK_EQ(o.value(), std::string("97"));
+    CHECK_EQ(o.sequence(), 2ull);
+    CHECK(o.net.until([&o]() { return !o.resyncs.empty(); }));
+    CHECK_EQ(o.resyncs.front(), o.group);
+
+    // the full result that answers it applies whatever its sequence
+    o.deliver(5, "90");
+    CHECK_EQ(o.value(), std::string("90"));
+    CHECK_EQ(o.sequence(), 5ull);
+
+    o.deliver(6, "89", "90");
+    CHECK_EQ(o.value(), std::string("89"));
+}
+
+TEST(updates_resync_a_delta_without_a_base) {
+    observing o;
+
+    // joined late, the first thing seen is a delta
+    o.deliver(8, "50", "51");
+    CHECK_EQ(o.value(), std::string("NULL"));
+    CHECK_EQ(o.sequence(), 0ull);
+    CHECK(o.net.until([&o]() { return !o.resyncs.empty(); }));
+}
+
+TEST(updates_resync_a_delta_on_a_string) {
+    observing o;
+    o.deliver(1, "Fippy Darkpaw");
+    o.deliver(2, "3", "2");
+    CHECK_EQ(o.value(), std::string("Fippy Darkpaw"));
+    CHECK(o.net.until([&o]() { return !o.resyncs.empty(); }));
+}
+
+TEST(malformed_updates_change_nothing) {
+    observing o;
+    o.deliver(1, "100");
+
+    frame_buffer frame(wire_v3);
+    MQ2DanNet::Updates::body::encode(frame, 9ull);
+    MQ2DanNet::UpdatesRecord::encode(frame, o.group, 2ull);
+    frame.write_byte(0x7f); // no such value tag
+    MQ2DanNet::message args(o.alice.node, o.bob.name(), std::string(), std::move(frame));
+    MQ2DanNet::Updates::callback(args);
+
+    CHECK_EQ(o.value(), std::string("100"));
+    CHECK_EQ(o.sequence(), 1ull);
+}
+
+// end to end: bob's value changes and alice follows it through Updates
+TEST(observed_changes_arrive_in_order) {
+    cluster net;
+    test_node& alice = net.add("Alice");
+    test_node& bob = net.add("Bob");
+    CHECK(net.until([&]() { return alice.node.get_peers().count(bob.name()) > 0; }));
+
+    bob.node.observe_delay(1);
+    bob.client.values["Me.PctHPs"] = "100";
+    alice.node.whisper<MQ2DanNet::Observe>(bob.name(), std::string("Me.PctHPs"), std::string(), 1u, 0u);
+    auto reads = [&](const std::string& value) {
+        return alice.node.can_read(bob.name(), "Me.PctHPs") && alice.node.read(bob.name(), "Me.PctHPs")->data.str() == value;
+    };
+    CHECK(net.until([&]() { return reads("100"); }));
+
+    for (int hp = 99; hp >= 90; --hp) {
+        bob.client.values["Me.PctHPs"] = std::to_string(hp);
+        CHECK(net.until([&]() { return reads(std::to_string(hp)); }));
+    }
+}
+
+TEST(sent_result_tracks_the_last_result) {
+    sent_result sent;
+    CHECK(!sent.matches(""));
+    CHECK(sent.previous().empty());
+
+    sent.store("100");
+    CHECK(sent.matches("100"));
+    CHECK(!sent.matches("10"));
+    CHECK(!sent.matches("1000"));
+    CHECK_EQ(std::string(sent.previous()), std::string("100"));
+
+    // same size and same leading bytes still differ
+    const std::string long_result(300, 'x');
+    sent.store(long_result);
+    CHECK(!sent.matches(long_result.substr(0, 299) + "y"));
+    CHECK(sent.matches(long_result));
+
+    // shorter results go into the storage already there
+    const char* storage = sent.value.data();
+    sent.store("1");
+    CHECK(sent.value.data() == storage);
+    CHECK(sent.matches("1"));
+
+    sent.clear();
+    CHECK(!sent.matches("1"));
+    CHECK(sent.previous().empty());
+}
+
+// bob observed by alice, counting the results that reach her
+struct publishing final {
+    cluster net;
+    test_node& alice;
+    test_node& bob;
+    size_t received = 0;
+
+    explicit publishing(unsigned int heartbeat = 0) : alice(net.add("Alice")), bob(net.add("Bob")) {
+        if (!net.until([this]() { return alice.node.get_peers().count(bob.name()) > 0; }))
+            throw harness::failure{ "peers never met" };
+
+        // a result can come either way, depending on whether bob has seen alice's wire version yet
+        alice.node.register_command(Node::name<MQ2DanNet::Update>(), [this](const MQ2DanNet::message& args) -> bool {
+            ++received;
+            return MQ2DanNet::Update::callback(args);
+        });
+        alice.node.register_command(Node::name<MQ2DanNet::Updates>(), [this](const MQ2DanNet::message& args) -> bool {
+            ++received;
+            return MQ2DanNet::Updates::callback(args);
+        });
+
+        bob.node.observe_delay(1);
+        bob.client.values["Me.PctHPs"] = "100";
+        alice.node.whisper<MQ2DanNet::Observe>(bob.name(), std::string("Me.PctHPs"), std::string(), 1u, heartbeat);
+        if (!net.until([this]() { return reads("100"); }))
+            throw harness::failure{ "first result never arrived" };
+
+        // the first result comes back with the observe response, which leaves alice without a sequence to apply deltas
+        // to. The first change after that is resynced, so let it settle before anything is counted
+        bob.client.values["Me.PctHPs"] = "99";
+        if (!net.until([this]() { observed_value last; return reads("99") && alice.node.last_sequence(bob.name() + "_0", last) > 0; }))
+            throw harness::failure{ "never resynced" };
+        run(20);
+    }
+
+    bool reads(const std::string& value) {
+        return alice.node.can_read(bob.name(), "Me.PctHPs") && alice.node.read(bob.name(), "Me.PctHPs")->data.str() == value;
+    }
+
+    // keeps everyone pulsing for a while
+    void run(unsigned int ms) { net.until([]() { return false; }, std::chrono::milliseconds(ms)); }
+};
+
+TEST(unchanged_results_are_not_resent) {
+    publishing p;
+    const size_t received = p.received;
+    const size_t evaluations = p.bob.client.evaluations;
+
+    p.run(50);
+    CHECK(p.bob.client.evaluations > evaluations);
+    CHECK_EQ(p.received, received);
+
+    p.bob.client.values["Me.PctHPs"] = "98";
+    CHECK(p.net.until([&p]() { return p.reads("98"); }));
+    CHECK_EQ(p.received, received + 1);
+
+    // going back to something sent before is still a change
+    p.bob.client.values["Me.PctHPs"] = "99";
+    CHECK(p.net.until([&p]() { return p.reads("99"); }));
+    CHECK_EQ(p.received, received + 2);
+}
+
+TEST(cleared_results_go_out_again) {
+    publishing p;
+    const size_t received = p.received;
+
+    p.bob.node.clear_observer_cache();
+    CHECK(p.net.until([&p, received]() { return p.received > received; }));
+    CHECK(p.reads("99"));
+
+    p.run(50);
+    CHECK_EQ(p.received, received + 1);
+}
+
+TEST(heartbeats_resend_unchanged_results) {
+    publishing p(20);
+    const size_t received = p.received;
+
+    CHECK(p.net.until([&p, received]() { return p.received >= received + 2; }));
+    CHECK(p.reads("99"));
+}
+
+// bob on his own, with observers registered straight on him as if alice had asked for them
+struct scheduled final {
+    cluster net;
+    test_node& bob;
+
+    scheduled() : bob(net.add("Bob")) {}
+
+    void run(unsigned int ms) { net.until([]() { return false; }, std::chrono::milliseconds(ms)); }
+    size_t evaluated(const std::string& query) { return bob.client.evaluated[query]; }
+};
+
+TEST(observers_run_at_their_own_rate) {
+    scheduled s;
+    s.bob.node.register_observer("test_alice", "Fast", 5);
+    s.bob.node.register_observer("test_alice", "Slow", 1000);
+    s.run(200);
+
+    CHECK(s.evaluated("Fast") >= 10);
+    CHECK(s.evaluated("Fast") <= 41);
+    CHECK_EQ(s.evaluated("Slow"), static_cast<size_t>(1)); // due straight away, and not again for a second
+}
+
+TEST(the_fastest_request_wins) {
+    scheduled s;
+    s.bob.node.register_observer("test_alice", "Shared", 1000);
+    s.run(50);
+    CHECK_EQ(s.evaluated("Shared"), static_cast<size_t>(1));
+
+    s.bob.node.register_observer("test_carol", "Shared", 5);
+    CHECK_EQ(s.bob.node.observer_count(), static_cast<size_t>(1));
+    s.run(100);
+    CHECK(s.evaluated("Shared") >= 5);
+}
+
+TEST(unregistered_observers_stop) {
+    scheduled s;
+    s.bob.node.register_observer("test_alice", "Gone", 5);
+    s.bob.node.register_observer("test_alice", "Kept", 5);
+    s.run(50);
+    CHECK(s.evaluated("Gone") > 0);
+
+    s.bob.node.unregister_observer("Gone");
+    const size_t gone = s.evaluated("Gone");
+    const size_t kept = s.evaluated("Kept");
+    s.run(50);
+    CHECK_EQ(s.evaluated("Gone"), gone);
+    CHECK(s.evaluated("Kept") > kept);
+    CHECK_EQ(s.bob.node.observer_count(), static_cast<size_t>(1));
+}
+
+// the number in front of "refreshes" on the observer stats line
+static unsigned __int64 refreshes(Node& node) {
+    for (const std::string& line : node.get_stats()) {
+        const size_t end = line.find(" refreshes");
+        if (end == std::string::npos)
+            continue;
+
+        const size_t begin = line.rfind(' ', end - 1) + 1;
+        return std::stoull(line.substr(begin, end - begin));
+    }
+
+    throw harness::failure{ "no refreshes on the stats line" };
+}
+
+TEST(requests_are_only_worked_out_again_when_membership_moves) {
+    scheduled s;
+    s.bob.node.register_observer("test_alice", "Idle", 5);
+    s.run(50);
+    CHECK(s.evaluated("Idle") >= 2);
+
+    const unsigned __int64 settled = refreshes(s.bob.node);
+    s.run(100);
+    CHECK_EQ(refreshes(s.bob.node), settled);
+
+    test_node& carol = s.net.add("Carol");
+    CHECK(s.net.until([&s, &carol]() { return s.bob.node.get_peers().count(carol.name()) > 0; }));
+    s.run(50);
+    CHECK(refreshes(s.bob.node) > settled);
+}
@@ -0,0 +1,90 @@
+/* MQ2DanNet tests -- the plugin half, built against the stand-in MQ headers in mq/. Observations hand anything they don't
+ * have themselves off to the MQ type of their value, so ${DanNet[x].O[Me.PctHPs].Float} is int's Float.
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+// reads member off an observation of text, the way the TLO would, and says which type it ended up asking. Strings point
+// into the observation, so it's kept around
+static stand_in_type* forward(const std::string& text, const char* member, MQTypeVar& dest) {
+    static MQ2DanNet::Node::Observation observation;
+    observation = MQ2DanNet::Node::Observation(std::string(), text, 1);
+
+    MQ2DanObservationType type;
+
+    MQVarPtr ptr{};
+    ptr.Ptr = &observation;
+    char index[MAX_STRING] = { 0 };
+    if (!type.GetMember(ptr, member, index, dest))
+        return nullptr;
+
+    return static_cast<stand_in_type*>(dest.Type);
+}
+
+TEST(ints_forward_to_int) {
+    MQTypeVar dest{};
+    stand_in_type* type = forward("87", "Float", dest);
+    CHECK(type == mq::datatypes::pIntType);
+    CHECK_EQ(type->member, std::string("Float"));
+    CHECK_EQ(type->asked.Int, 87);
+
+    type = forward("-5", "Hex", dest);
+    CHECK(type == mq::datatypes::pIntType);
+    CHECK_EQ(type->asked.Int, -5);
+}
+
+TEST(big_ints_forward_to_int64) {
+    MQTypeVar dest{};
+    stand_in_type* type = forward("12345678901", "Float", dest);
+    CHECK(type == mq::datatypes::pInt64Type);
+    CHECK_EQ(type->asked.Int64, static_cast<int64_t>(12345678901ll));
+}
+
+TEST(decimals_forward_to_double) {
+    MQTypeVar dest{};
+    stand_in_type* type = forward("42.25", "Int", dest);
+    CHECK(type == mq::datatypes::pDoubleType);
+    CHECK_EQ(type->member, std::string("Int"));
+    CHECK_EQ(type->asked.Double, 42.25);
+}
+
+TEST(bools_forward_to_bool) {
+    MQTypeVar dest{};
+    stand_in_type* type = forward("TRUE", "Anything", dest);
+    CHECK(type == mq::datatypes::pBoolType);
+    CHECK_EQ(type->asked.DWord, 1ul);
+
+    type = forward("FALSE", "Anything", dest);
+    CHECK(type == mq::datatypes::pBoolType);
+    CHECK_EQ(type->asked.DWord, 0ul);
+}
+
+TEST(strings_forward_to_string) {
+    MQTypeVar dest{};
+    stand_in_type* type = forward("Shaman", "Length", dest);
+    CHECK(type == mq::datatypes::pStringType);
+    CHECK_EQ(std::string(static_cast<const char*>(type->asked.Ptr)), std::string("Shaman"));
+}
+
+TEST(null_has_nothing_to_forward_to) {
+    MQTypeVar dest{};
+    CHECK(forward("NULL", "Float", dest) == nullptr);
+}
+
+TEST(received_is_the_observations_own) {
+    MQ2DanObservationType type;
+    MQ2DanNet::Node::Observation observation(std::string(), std::string("87"), 1234);
+
+    MQVarPtr ptr{};
+    ptr.Ptr = &observation;
+    char index[MAX_STRING] = { 0 };
+    MQTypeVar dest{};
+    CHECK(type.GetMember(ptr, "Received", index, dest));
+    CHECK(dest.Type == mq::datatypes::pInt64Type);
+    CHECK_EQ(dest.UInt64, 1234ull);
+
+    char text[MAX_STRING] = { 0 };
+    CHECK(type.ToString(ptr, text));
+    CHECK_EQ(std::string(text), std::string("87"));
+}
@@ -0,0 +1,43 @@
+/* MQ2DanNet queries bench -- what building the ${query} expression on every evaluation costs against building it once
+ *
+ *   queries_bench [evaluations]
+ *
+ * The host is the test stand-in, which only looks the query up in a map, so what's left is mostly the node's side of
+ * it. MQ's ParseMacroData has no compiled form to hold on to, so the expression string is all there is to keep.
+ */
+
+#include "test_node.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using bench_clock = std::chrono::steady_clock;
+
+static volatile size_t sink = 0;
+
+template <typename F>
+static double ns_per(size_t count, F&& f) {
+    const auto start = bench_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        sink = sink + f().size();
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::max(1, atoi(argv[1])) : 1000000;
+
+    test_host client("Bench");
+    MQ2DanNet::Node node(client);
+
+    const std::vector<std::string> queries = { "Me.PctHPs", "Target.Buff[Slow].Duration.TotalSeconds", "Spawn[pc group Alice].Distance3D" };
+    for (auto& query : queries) {
+        client.values[query] = "100";
+        const std::string expression = "${" + query + "}";
+
+        const double built = ns_per(count, [&node, &query]() { return node.parse_query(query); });
+        const double kept = ns_per(count, [&client, &expression]() { return client.evaluate(expression); });
+        printf("%-42s built each time %7.1f ns, built once %7.1f ns (%.0f%%)\n", query.c_str(), built, kept, built > 0 ? 100.0 * (built - kept) / built : 0.0);
+    }
+
+    return 0;
+}
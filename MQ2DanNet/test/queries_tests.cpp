@@ -0,0 +1,61 @@
+/* MQ2DanNet tests -- evaluating queries through the host, and observers backing off from the expensive ones
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+// bob on his own, with observers registered straight on him as if alice had asked for them
+struct evaluating final {
+    cluster net;
+    test_node& bob;
+
+    evaluating() : bob(net.add("Bob")) {}
+
+    void run(unsigned int ms) { net.until([]() { return false; }, std::chrono::milliseconds(ms)); }
+    size_t evaluated(const std::string& query) { return bob.client.evaluated[query]; }
+};
+
+TEST(queries_go_to_the_host_wrapped) {
+    evaluating e;
+    e.bob.client.values["Me.PctHPs"] = "87";
+    CHECK_EQ(e.bob.node.parse_query("Me.PctHPs"), std::string("87"));
+    CHECK_EQ(e.bob.client.expression, std::string("${Me.PctHPs}"));
+    CHECK_EQ(e.bob.node.parse_query("Me.Missing"), std::string("NULL"));
+}
+
+TEST(observers_evaluate_the_same_expression) {
+    evaluating e;
+    e.bob.client.values["Me.PctMana"] = "42";
+    e.bob.node.register_observer("test_alice", "Me.PctMana", 5);
+    e.run(50);
+
+    CHECK(e.evaluated("Me.PctMana") >= 2);
+    CHECK_EQ(e.bob.client.expression, std::string("${Me.PctMana}"));
+}
+
+TEST(expensive_queries_back_off) {
+    evaluating e;
+    e.bob.client.costs["Slow"] = std::chrono::milliseconds(20);
+    e.bob.node.register_observer("test_alice", "Slow", 5);
+    e.bob.node.register_observer("test_alice", "Fast", 5);
+    e.run(300);
+
+    // 20 ms a go puts the next one 200 ms out, where the fast one keeps to its rate
+    CHECK(e.evaluated("Slow") >= 1);
+    CHECK(e.evaluated("Slow") <= 3);
+    CHECK(e.evaluated("Fast") >= 10);
+}
+
+TEST(large_results_keep_their_rate) {
+    evaluating e;
+    e.bob.node.register_observer("test_alice", "Big", 5);
+
+    // every evaluation is a new, large result, so each one is stored and goes out. Only the evaluation counts towards
+    // the backoff, and that's a map lookup here
+    for (int i = 0; i < 40; ++i) {
+        e.bob.client.values["Big"] = std::string(64 * 1024, static_cast<char>('a' + i % 26));
+        e.run(5);
+    }
+
+    CHECK(e.evaluated("Big") >= 20);
+}
@@ -0,0 +1,121 @@
+/* MQ2DanNet queue bench -- the spsc_ring the actor hands commands over in, against the locked_queue it replaced
+ *
+ *   queue_bench [commands]
+ *
+ * locked_queue is copied here as it was: a mutex around a deque, emplace on the front and pop off the front. Each
+ * queue is timed on one thread (what a pulse costs when the actor is quiet) and with the actor's thread pushing while
+ * the game thread pops.
+ */
+
+#include "test_node.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using bench_clock = std::chrono::steady_clock;
+
+template <typename T>
+class locked_queue {
+private:
+    std::mutex _mutex;
+    std::deque<T> _queue;
+
+public:
+    //emplace empty front pop
+    template <class... Args>
+    void emplace(Args&&... args) {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        _queue.emplace_front(std::forward<Args>(args)...);
+    }
+
+    T pop() {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        T r;
+        if (!_queue.empty()) {
+            r = std::move(_queue.front());
+            _queue.pop_front(); // go ahead and pop it off, we've moved it
+        }
+        return r;
+    }
+};
+
+using command = std::string; // roughly what a queued message moves around, a pointer and a size
+
+static constexpr size_t ring_size = 4096;
+
+static double ns_since(bench_clock::time_point start, size_t count) {
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+}
+
+// bursts of a pulse's worth, pushed and then drained on the same thread
+static double ring_one_thread(size_t count) {
+    spsc_ring<command, ring_size> ring;
+    command out;
+    const auto start = bench_clock::now();
+    for (size_t done = 0; done < count; done += 64) {
+        for (size_t i = 0; i < 64; ++i)
+            ring.push(command(40, 'x'));
+        while (ring.pop(out)) {}
+    }
+    return ns_since(start, count);
+}
+
+static double locked_one_thread(size_t count) {
+    locked_queue<command> queue;
+    const auto start = bench_clock::now();
+    for (size_t done = 0; done < count; done += 64) {
+        for (size_t i = 0; i < 64; ++i)
+            queue.emplace(40, 'x');
+        while (!queue.pop().empty()) {}
+    }
+    return ns_since(start, count);
+}
+
+static double ring_two_threads(size_t count) {
+    spsc_ring<command, ring_size> ring;
+    const auto start = bench_clock::now();
+    std::thread producer([&ring, count]() {
+        for (size_t i = 0; i < count;) {
+            if (ring.push(command(40, 'x')))
+                ++i;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    command out;
+    for (size_t received = 0; received < count;) {
+        if (ring.pop(out))
+            ++received;
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+    return ns_since(start, count);
+}
+
+static double locked_two_threads(size_t count) {
+    locked_queue<command> queue;
+    const auto start = bench_clock::now();
+    std::thread producer([&queue, count]() {
+        for (size_t i = 0; i < count; ++i)
+            queue.emplace(40, 'x');
+    });
+
+    for (size_t received = 0; received < count;) {
+        if (!queue.pop().empty())
+            ++received;
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+    return ns_since(start, count);
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::max(64, atoi(argv[1])) : 2000000;
+
+    printf("one thread:  spsc_ring %6.1f ns, locked_queue %6.1f ns per command\n", ring_one_thread(count), locked_one_thread(count));
+    printf("two threads: spsc_ring %6.1f ns, locked_queue %6.1f ns per command\n", ring_two_threads(count), locked_two_threads(count));
+    return 0;
+}
@@ -0,0 +1,256 @@
+/* MQ2DanNet tests -- the rings the actor hands commands to the game thread through, and draining them each pulse
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+#include <thread>
+
+using ring = spsc_ring<int, 8>;
+
+static std::vector<int> drain(ring& queue) {
+    std::vector<int> values;
+    int value = 0;
+    while (queue.pop(value))
+        values.push_back(value);
+    return values;
+}
+
+TEST(ring_is_first_in_first_out) {
+    ring queue;
+    CHECK(queue.peek() == nullptr);
+    for (int i = 1; i <= 5; ++i)
+        CHECK(queue.push(int(i)));
+
+    CHECK_EQ(queue.size(), static_cast<size_t>(5));
+    CHECK_EQ(*queue.peek(), 1);
+    CHECK(drain(queue) == std::vector<int>({ 1, 2, 3, 4, 5 }));
+    CHECK_EQ(queue.size(), static_cast<size_t>(0));
+
+    int value = 0;
+    CHECK(!queue.pop(value));
+}
+
+TEST(full_ring_drops_and_counts) {
+    ring queue;
+    for (int i = 0; i < static_cast<int>(ring::capacity()); ++i)
+        CHECK(queue.push(int(i)));
+
+    CHECK(!queue.push(100));
+    CHECK(!queue.push(101));
+    CHECK_EQ(queue.overflows(), 2ull);
+    CHECK_EQ(queue.size(), ring::capacity());
+    CHECK_EQ(queue.high_water(), ring::capacity());
+
+    // one out makes room for exactly one more
+    int value = -1;
+    CHECK(queue.pop(value));
+    CHECK_EQ(value, 0);
+    CHECK(queue.push(102));
+    CHECK(!queue.push(103));
+    CHECK_EQ(queue.overflows(), 3ull);
+    CHECK_EQ(drain(queue).back(), 102);
+}
+
+TEST(ring_wraps_around) {
+    ring queue;
+    int next = 0, expected = 0;
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < 3 + round % 5; ++i)
+            CHECK(queue.push(next++));
+
+        for (int value : drain(queue))
+            CHECK_EQ(value, expected++);
+    }
+
+    CHECK_EQ(expected, next);
+    CHECK_EQ(queue.overflows(), 0ull);
+    CHECK_EQ(queue.high_water(), static_cast<size_t>(7));
+}
+
+TEST(removed_values_are_skipped) {
+    ring queue;
+    for (int i = 1; i <= 6; ++i)
+        CHECK(queue.push(int(i)));
+
+    queue.remove_if([](int& value) { return value % 2 == 1; });
+    CHECK_EQ(*queue.peek(), 2);
+    CHECK(drain(queue) == std::vector<int>({ 2, 4, 6 }));
+
+    // removing everything leaves nothing to peek at, and the slots are free again
+    for (int i = 0; i < static_cast<int>(ring::capacity()); ++i)
+        CHECK(queue.push(int(i)));
+    queue.remove_if([](int&) { return true; });
+    CHECK(queue.peek() == nullptr);
+    CHECK_EQ(queue.size(), static_cast<size_t>(0));
+    CHECK(queue.push(42));
+    CHECK(drain(queue) == std::vector<int>({ 42 }));
+}
+
+TEST(popped_slots_let_go) {
+    spsc_ring<std::shared_ptr<int>, 4> queue;
+    auto value = std::make_shared<int>(7);
+    CHECK(queue.push(std::shared_ptr<int>(value)));
+    CHECK(queue.push(std::shared_ptr<int>(value)));
+    CHECK_EQ(value.use_count(), 3l);
+
+    std::shared_ptr<int> popped;
+    CHECK(queue.pop(popped));
+    popped.reset();
+    CHECK_EQ(value.use_count(), 2l);
+
+    queue.remove_if([](std::shared_ptr<int>&) { return true; });
+    CHECK(queue.peek() == nullptr);
+    CHECK_EQ(value.use_count(), 1l);
+}
+
+TEST(producer_and_consumer_threads_keep_order) {
+    constexpr int count = 200000;
+    spsc_ring<int, 64> queue;
+
+    std::thread producer([&queue]() {
+        for (int i = 0; i < count;) {
+            if (queue.push(int(i)))
+                ++i;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    int expected = 0, value = 0;
+    bool ordered = true;
+    while (expected < count) {
+        if (queue.pop(value))
+            ordered = ordered && value == expected++;
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+
+    CHECK(ordered);
+    CHECK_EQ(queue.size(), static_cast<size_t>(0));
+    CHECK(queue.high_water() <= queue.capacity());
+}
+
+// bob with a burst of executes from alice waiting in his queue, none of them handled yet
+struct backlogged final {
+    static constexpr size_t burst = 30;
+
+    cluster net;
+    test_node& alice;
+    test_node& bob;
+
+    backlogged() : alice(net.add("Alice")), bob(net.add("Bob")) {
+        if (!net.until([this]() { return alice.node.has_peer(bob.name()); }))
+            throw harness::failure{ "peers never met" };
+
+        for (size_t i = 0; i < burst; ++i)
+            alice.node.whisper<MQ2DanNet::Execute>(bob.name(), "/echo " + std::to_string(i));
+
+        // the actor queues them as they come in, only the drain hands them to the game thread
+        const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (bob.node.backlog() < burst && std::chrono::steady_clock::now() < give_up)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (bob.node.backlog() != burst)
+            throw harness::failure{ "burst never arrived" };
+    }
+};
+
+TEST(a_burst_drains_in_one_pulse) {
+    backlogged b;
+    b.bob.node.drain();
+    CHECK_EQ(b.bob.node.backlog(), static_cast<size_t>(0));
+    CHECK_EQ(b.bob.client.executed.size(), backlogged::burst);
+    for (size_t i = 0; i < b.bob.client.executed.size(); ++i)
+        CHECK_EQ(b.bob.client.executed[i], "/echo " + std::to_string(i));
+}
+
+TEST(a_spent_budget_still_makes_progress) {
+    backlogged b;
+    b.bob.node.drain_budget(0);
+    for (size_t i = 1; i <= backlogged::burst; ++i) {
+        b.bob.node.drain();
+        CHECK_EQ(b.bob.client.executed.size(), i);
+        CHECK_EQ(b.bob.node.backlog(), backlogged::burst - i);
+    }
+
+    b.bob.node.drain();
+    CHECK_EQ(b.bob.client.executed.size(), backlogged::burst);
+}
+
+// bob with executes (interactive) and resyncs (bulk) from alice waiting in his queues, logging which lane each one
+// came off as he handles them
+struct laned final {
+    cluster net;
+    test_node& alice;
+    test_node& bob;
+    std::string handled; // i for interactive, b for bulk, in the order bob got to them
+
+    laned() : alice(net.add("Alice")), bob(net.add("Bob")) {
+        if (!net.until([this]() { return alice.node.has_peer(bob.name()); }))
+            throw harness::failure{ "peers never met" };
+
+        bob.node.register_command(MQ2DanNet::Node::name<MQ2DanNet::Execute>(), [this](const MQ2DanNet::message&) -> bool {
+            handled += 'i';
+            return false;
+        });
+        bob.node.register_command(MQ2DanNet::Node::name<MQ2DanNet::Resync>(), [this](const MQ2DanNet::message&) -> bool {
+            handled += 'b';
+            return false;
+        });
+    }
+
+    // everything interactive goes out before anything bulk, so only the scheduling can interleave them
+    void queue(size_t interactive, size_t bulk) {
+        for (size_t i = 0; i < interactive; ++i)
+            alice.node.whisper<MQ2DanNet::Execute>(bob.name(), "/echo " + std::to_string(i));
+        for (size_t i = 0; i < bulk; ++i)
+            alice.node.whisper<MQ2DanNet::Resync>(bob.name(), std::set<std::string>{ alice.name() + "_" + std::to_string(i) });
+
+        const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (bob.node.backlog() < interactive + bulk && std::chrono::steady_clock::now() < give_up)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (bob.node.backlog() != interactive + bulk)
+            throw harness::failure{ "commands never arrived" };
+    }
+
+    bool overdue() {
+        for (const std::string& line : bob.node.get_stats()) {
+            if (line.find("overdue") != std::string::npos)
+                return true;
+        }
+
+        return false;
+    }
+};
+
+TEST(four_interactive_go_for_each_bulk) {
+    laned l;
+    l.queue(10, 3);
+    l.bob.node.drain();
+    CHECK_EQ(l.handled, std::string("iiiibiiiibiib"));
+    CHECK(!l.overdue());
+}
+
+TEST(an_overdue_bulk_command_jumps_the_queue) {
+    laned l;
+    l.queue(8, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    l.bob.node.drain();
+    CHECK_EQ(l.handled, std::string("biiiiiiii"));
+    CHECK(l.overdue());
+}
+
+TEST(credit_carries_over_between_pulses) {
+    laned l;
+    l.queue(10, 3);
+    l.bob.node.drain_budget(0);
+    for (size_t i = 1; i <= 13; ++i) {
+        l.bob.node.drain();
+        CHECK_EQ(l.handled.size(), i);
+    }
+
+    // one at a time comes out the same as all at once
+    CHECK_EQ(l.handled, std::string("iiiibiiiibiib"));
+    CHECK(!l.overdue());
+}
@@ -0,0 +1,157 @@
+/* MQ2DanNet schedule bench -- finding the due observers each pulse, the min-heap against walking every observer
+ *
+ *   schedule_bench [pulses]
+ *
+ * Only the scheduling is timed; nothing is evaluated. The scan is what publish_updates did before the heap: walk the
+ * whole locked observer map, which handed each entry over by value, check it against its interval, and write the due
+ * ones back afterwards. The heap is what it does now: pop the due ones off a priority_queue and push them back with
+ * their next due. A scan that walks the map in place, without the copies, is timed too, to show how much of the
+ * difference is the copying rather than the walk. Intervals are spread the way observe rates and the 10x benchmark backoff spread them, and a pulse is
+ * 16 ms of ticks.
+ */
+
+#include "test_node.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <random>
+
+using bench_clock = std::chrono::steady_clock;
+
+struct observer final {
+    std::string query; // so a copy costs what copying a Query did, give or take
+    unsigned __int64 interval;
+    unsigned __int64 last = 0;
+    unsigned __int64 due = 0;
+};
+
+struct scheduled_observer final {
+    unsigned __int64 due;
+    unsigned int key;
+
+    bool operator>(const scheduled_observer& rhs) const { return due > rhs.due; }
+};
+
+static std::map<unsigned int, observer> make_observers(size_t count) {
+    static const unsigned __int64 intervals[] = { 50, 100, 250, 1000, 1000, 1000, 5000 };
+    std::mt19937 random(static_cast<unsigned int>(count));
+    std::map<unsigned int, observer> observers;
+    for (unsigned int key = 0; key < count; ++key)
+        observers[key] = observer{ "Target.Buff[Slow].Duration.TotalSeconds", intervals[random() % std::size(intervals)] };
+    return observers;
+}
+
+static constexpr unsigned __int64 start_tick = 100000; // far enough out that every observer is due on the first pulse
+
+struct run_stats final {
+    double ns = 0;  // per pulse
+    size_t due = 0; // evaluations over the run
+};
+
+// the parts of locked_map the scan used, as they were then
+template <typename T, typename U>
+class locked_map {
+private:
+    std::mutex _mutex;
+    std::map<T, U> _map;
+
+public:
+    explicit locked_map(std::map<T, U>&& map) : _map(std::move(map)) {}
+
+    void upsert(const T& n, const U& v) {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        _map[n] = v;
+    }
+
+    void foreach (std::function<void(std::pair<T, U>)> f) {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        for (auto it = _map.begin(); it != _map.end(); ++it) {
+            f(*it);
+        }
+    }
+};
+
+static run_stats scan(size_t count, size_t pulses) {
+    locked_map<unsigned int, observer> observers(make_observers(count));
+
+    run_stats stats;
+    unsigned __int64 tick = start_tick;
+    const auto start = bench_clock::now();
+    for (size_t pulse = 0; pulse < pulses; ++pulse, tick += 16) {
+        std::map<unsigned int, observer> updated;
+        observers.foreach([tick, &updated](std::pair<unsigned int, observer> entry) {
+            if (tick - entry.second.last >= entry.second.interval) {
+                entry.second.last = tick;
+                updated[entry.first] = entry.second;
+            }
+        });
+
+        for (auto& entry : updated)
+            observers.upsert(entry.first, entry.second);
+        stats.due += updated.size();
+    }
+
+    stats.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / pulses;
+    return stats;
+}
+
+static run_stats scan_in_place(size_t count, size_t pulses) {
+    std::map<unsigned int, observer> observers = make_observers(count);
+
+    run_stats stats;
+    unsigned __int64 tick = start_tick;
+    const auto start = bench_clock::now();
+    for (size_t pulse = 0; pulse < pulses; ++pulse, tick += 16) {
+        for (auto& entry : observers) {
+            if (tick - entry.second.last >= entry.second.interval) {
+                entry.second.last = tick;
+                ++stats.due;
+            }
+        }
+    }
+
+    stats.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / pulses;
+    return stats;
+}
+
+static run_stats heap(size_t count, size_t pulses) {
+    std::map<unsigned int, observer> observers = make_observers(count);
+    std::priority_queue<scheduled_observer, std::vector<scheduled_observer>, std::greater<scheduled_observer>> schedule;
+    for (auto& entry : observers)
+        schedule.push(scheduled_observer{ 0, entry.first });
+
+    run_stats stats;
+    unsigned __int64 tick = start_tick;
+    const auto start = bench_clock::now();
+    for (size_t pulse = 0; pulse < pulses; ++pulse, tick += 16) {
+        while (!schedule.empty() && schedule.top().due <= tick) {
+            const scheduled_observer next = schedule.top();
+            schedule.pop();
+
+            observer& o = observers.find(next.key)->second;
+            o.last = tick;
+            o.due = tick + o.interval;
+            schedule.push(scheduled_observer{ o.due, next.key });
+            ++stats.due;
+        }
+    }
+
+    stats.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / pulses;
+    return stats;
+}
+
+int main(int argc, char** argv) {
+    const size_t pulses = argc > 1 ? std::max(1, atoi(argv[1])) : 20000;
+
+    for (size_t count : { 10, 100, 1000, 10000 }) {
+        const run_stats before = scan(count, pulses);
+        const run_stats in_place = scan_in_place(count, pulses);
+        const run_stats after = heap(count, pulses);
+        printf("%5zu observers, %8zu due: scan %9.1f ns, scan in place %9.1f ns, heap %9.1f ns per pulse\n", count, after.due, before.ns, in_place.ns, after.ns);
+        if (before.due != after.due || in_place.due != after.due)
+            printf("  the schedules disagree on what was due: %zu, %zu, %zu\n", before.due, in_place.due, after.due);
+    }
+
+    return 0;
+}
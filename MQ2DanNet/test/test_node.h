@@ -0,0 +1,189 @@
+/* MQ2DanNet tests -- the node built without the client, and a host to run it on
+ *
+ * Nodes talk to each other over the loopback bus (loopback/zyre.h). Everything that would be the game thread is the
+ * thread that made the node, and it only moves when it's pulsed.
+ */
+
+#pragma once
+
+#include "../MQ2DanNet.cpp"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// stands in for the client: queries read from values, everything written is kept so a test can look at it
+class test_host final : public MQ2DanNet::host {
+public:
+    explicit test_host(const std::string& character, const std::string& server = "test")
+        : character(character), server(server), _main(std::this_thread::get_id()) {}
+
+    std::string character;
+    std::string server;
+    std::map<std::string, std::string> values;   // what ${<key>} evaluates to, anything else is NULL
+    std::map<std::string, std::string> settings; // section/key
+    std::vector<std::string> chat;
+    std::vector<std::string> executed;
+    std::vector<std::string> errors;
+    size_t evaluations = 0;
+    std::map<std::string, size_t> evaluated; // key, times evaluated
+    std::map<std::string, std::chrono::milliseconds> costs; // key, how long evaluating it takes
+    std::string expression;                    // the last one evaluated, as it was handed over
+
+    std::string evaluate(const std::string& expression) override {
+        ++evaluations;
+        this->expression = expression;
+        std::string key = expression;
+        if (key.size() >= 3 && key.compare(0, 2, "${") == 0 && key.back() == '}')
+            key = key.substr(2, key.size() - 3);
+
+        ++evaluated[key];
+        auto cost = costs.find(key);
+        if (cost != costs.end())
+            std::this_thread::sleep_for(cost->second);
+
+        auto it = values.find(key);
+        return it != values.end() ? it->second : "NULL";
+    }
+
+    void execute(const std::string& command) override { executed.push_back(command); }
+    void write_chat(const std::string& text) override { chat.push_back(text); }
+    std::string server_name() override { return server; }
+
+    unsigned __int64 tick() override {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void debug(const std::string&) override {}
+
+    std::string setting(const std::string& section, const std::string& key) override {
+        auto it = settings.find(section + "/" + key);
+        return it != settings.end() ? it->second : std::string();
+    }
+
+    std::string character_name() override { return character; }
+    bool on_main_thread() override { return std::this_thread::get_id() == _main; }
+
+    void post(std::function<void()> f) override {
+        std::scoped_lock<std::mutex> lock(_posted_mutex);
+        _posted.push_back(std::move(f));
+    }
+
+    // no macros out here, so responses always land as strings
+    bool in_macro() override { return false; }
+    bool has_variable(const std::string&) override { return false; }
+    bool store(const std::string&, const std::string&, std::string&, std::string&) override { return false; }
+    void macro_error(const std::string& text) override { errors.push_back(text); }
+
+    void run_posted() {
+        std::deque<std::function<void()>> posted;
+        {
+            std::scoped_lock<std::mutex> lock(_posted_mutex);
+            posted.swap(_posted);
+        }
+
+        for (auto& f : posted)
+            f();
+    }
+
+private:
+    const std::thread::id _main;
+    std::mutex _posted_mutex;
+    std::deque<std::function<void()>> _posted;
+};
+
+// a node set up the way InitializePlugin and SetGameState leave the plugin's, in game and on the bus
+class test_node final {
+public:
+    explicit test_node(const std::string& character, const std::string& server = "test") : client(character, server), node(client) {
+        node.register_command<MQ2DanNet::Echo>();
+        node.register_command<MQ2DanNet::Execute>();
+        node.register_command<MQ2DanNet::Query>();
+        node.register_command<MQ2DanNet::Observe>();
+        node.register_command<MQ2DanNet::Update>();
+        node.register_command<MQ2DanNet::Reupdate>();
+        node.register_command<MQ2DanNet::Updates>();
+        node.register_command<MQ2DanNet::Resync>();
+        node.register_command<MQ2DanNet::Probe>();
+
+        node.register_decoder<MQ2DanNet::Echo>(decode_echo);
+        node.register_decoder<MQ2DanNet::Execute>(decode_execute);
+        node.register_decoder<MQ2DanNet::Update>(decode_update);
+        node.register_decoder<MQ2DanNet::Updates>(decode_updates);
+
+        node.startup();
+        node.enter();
+        node.join("all");
+    }
+
+    ~test_node() { node.exit(); }
+
+    test_node(const test_node&) = delete;
+    test_node& operator=(const test_node&) = delete;
+
+    // what OnPulse does, less the group/raid/zone channels
+    void pulse() {
+        client.run_posted();
+        node.recv();
+        node.drain();
+        node.publish_updates();
+        node.probe_peers();
+    }
+
+    std::string name() { return node.name(); }
+
+    test_host client;
+    MQ2DanNet::Node node;
+};
+
+// a set of nodes pulsed together, like a box of clients on one machine
+class cluster final {
+public:
+    test_node& add(const std::string& character) {
+        _nodes.push_back(std::make_unique<test_node>(character));
+        return *_nodes.back();
+    }
+
+    void remove(test_node& node) {
+        _nodes.erase(std::remove_if(_nodes.begin(), _nodes.end(), [&node](const std::unique_ptr<test_node>& n) { return n.get() == &node; }), _nodes.end());
+    }
+
+    void pulse() {
+        for (auto& node : _nodes)
+            node->pulse();
+    }
+
+    // pulses everyone until done() holds, false if it still doesn't after timeout
+    bool until(const std::function<bool()>& done, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+        const auto give_up = std::chrono::steady_clock::now() + timeout;
+        while (!done()) {
+            if (std::chrono::steady_clock::now() >= give_up)
+                return false;
+
+            pulse();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        return true;
+    }
+
+    // everyone sees everyone else
+    bool converged() {
+        for (auto& node : _nodes) {
+            if (node->node.get_peers().size() != _nodes.size())
+                return false;
+        }
+
+        return true;
+    }
+
+    std::vector<std::unique_ptr<test_node>>& nodes() { return _nodes; }
+
+private:
+    std::vector<std::unique_ptr<test_node>> _nodes;
+};
@@ -0,0 +1,256 @@
+/* MQ2DanNet tests -- the wire encoding (varints, zigzag, fields read in place), the pooled buffers it goes out in, and the
+ * opcodes on the actor pipe
+ */
+
+#include "test_node.h"
+#include "harness.h"
+
+#include <limits>
+
+// what reading one varint from bytes gives, and how many bytes it took
+static bool decode(const std::string& bytes, unsigned __int64& value, size_t& used) {
+    const char* pos = bytes.data();
+    const bool ok = decode_varint(pos, bytes.data() + bytes.size(), value);
+    used = static_cast<size_t>(pos - bytes.data());
+    return ok;
+}
+
+static std::string varint(unsigned __int64 value) {
+    char buf[10];
+    return std::string(buf, encode_varint(value, buf));
+}
+
+TEST(varint_sizes) {
+    CHECK_EQ(varint(0), std::string(1, '\0'));
+    CHECK_EQ(varint(127), std::string(1, '\x7f'));
+    CHECK_EQ(varint(128), std::string("\x80\x01", 2));
+    CHECK_EQ(varint(300), std::string("\xac\x02", 2));
+    CHECK_EQ(varint(16383).size(), static_cast<size_t>(2));
+    CHECK_EQ(varint(16384).size(), static_cast<size_t>(3));
+    CHECK_EQ(varint(std::numeric_limits<unsigned __int64>::max()).size(), static_cast<size_t>(10));
+}
+
+TEST(varint_round_trip) {
+    const unsigned __int64 values[] = { 0, 1, 127, 128, 255, 300, 16383, 16384, 0xffffffffull, 0x100000000ull, std::numeric_limits<unsigned __int64>::max() };
+    for (auto value : values) {
+        const std::string bytes = varint(value) + "tail";
+        unsigned __int64 decoded = 0;
+        size_t used = 0;
+        CHECK(decode(bytes, decoded, used));
+        CHECK_EQ(decoded, value);
+        CHECK_EQ(used, bytes.size() - 4);
+    }
+}
+
+TEST(varint_truncated) {
+    unsigned __int64 value = 0;
+    size_t used = 0;
+    CHECK(!decode(std::string(), value, used));
+    CHECK(!decode(std::string("\x80", 1), value, used));
+    CHECK(!decode(varint(1ull << 40).substr(0, 3), value, used));
+    CHECK(!decode(std::string(11, '\xff'), value, used)); // never ends
+}
+
+TEST(zigzag) {
+    CHECK_EQ(zigzag_encode(0), 0ull);
+    CHECK_EQ(zigzag_encode(-1), 1ull);
+    CHECK_EQ(zigzag_encode(1), 2ull);
+    CHECK_EQ(zigzag_encode(-2), 3ull);
+    CHECK_EQ(zigzag_encode(std::numeric_limits<__int64>::max()), std::numeric_limits<unsigned __int64>::max() - 1);
+    CHECK_EQ(zigzag_encode(std::numeric_limits<__int64>::min()), std::numeric_limits<unsigned __int64>::max());
+
+    const __int64 values[] = { 0, 1, -1, 63, -64, 64, -65, 1234567, -1234567, std::numeric_limits<__int64>::max(), std::numeric_limits<__int64>::min() };
+    for (auto value : values)
+        CHECK_EQ(zigzag_decode(zigzag_encode(value)), value);
+}
+
+// a frame as it would go out, and a reader over it
+struct written final {
+    std::string bytes;
+    frame_reader reader(unsigned char version) const { return frame_reader(bytes.data(), bytes.size(), version); }
+};
+
+static written write(unsigned char version, std::initializer_list<std::string_view> fields) {
+    frame_buffer frame(version);
+    for (auto field : fields)
+        frame << field;
+    return written{ std::string(frame.data() ? frame.data() : "", frame.size()) };
+}
+
+TEST(fields_v1_are_big_endian_lengths) {
+    const written frame = write(wire_v1, { "abc", "" });
+    CHECK_EQ(frame.bytes, std::string("\0\0\0\x03" "abc" "\0\0\0\0", 11));
+
+    frame_reader reader = frame.reader(wire_v1);
+    std::string_view first, second;
+    reader >> first >> second;
+    CHECK_EQ(std::string(first), std::string("abc"));
+    CHECK(second.empty());
+    CHECK(reader.empty());
+}
+
+TEST(fields_v2_are_varint_lengths) {
+    const std::string long_field(200, 'x');
+    const written frame = write(wire_v2, { "abc", long_field });
+    CHECK_EQ(frame.bytes.substr(0, 4), std::string("\x03" "abc"));
+    CHECK_EQ(frame.bytes.substr(4, 2), std::string("\xc8\x01", 2));
+    CHECK_EQ(frame.bytes.size(), static_cast<size_t>(4 + 2 + 200));
+    CHECK_EQ(frame_buffer::field_size(200, wire_v2), static_cast<size_t>(202));
+    CHECK_EQ(frame_buffer::field_size(200, wire_v1), static_cast<size_t>(204));
+
+    frame_reader reader = frame.reader(wire_v2);
+    std::string_view first, second;
+    reader >> first >> second;
+    CHECK_EQ(std::string(first), std::string("abc"));
+    CHECK_EQ(std::string(second), long_field);
+    CHECK(reader.empty());
+}
+
+TEST(fields_are_read_in_place) {
+    const written frame = write(wire_v2, { "hello" });
+    frame_reader reader = frame.reader(wire_v2);
+    std::string_view field;
+    reader >> field;
+    CHECK(field.data() == frame.bytes.data() + 1);
+}
+
+TEST(malformed_fields_throw) {
+    // length runs past the end
+    const std::string short_v2("\x05" "abc", 4);
+    frame_reader v2(short_v2.data(), short_v2.size(), wire_v2);
+    std::string_view field;
+    CHECK_THROWS(v2 >> field, std::runtime_error);
+
+    const std::string short_v1("\0\0\0\x09" "abc", 7);
+    frame_reader v1(short_v1.data(), short_v1.size(), wire_v1);
+    CHECK_THROWS(v1 >> field, std::runtime_error);
+
+    // not even a whole length
+    const std::string stub("\0\0", 2);
+    frame_reader tiny(stub.data(), stub.size(), wire_v1);
+    CHECK_THROWS(tiny >> field, std::runtime_error);
+
+    frame_reader empty(nullptr, 0, wire_v2);
+    unsigned char byte = 0;
+    CHECK_THROWS(empty.read_byte(byte), std::runtime_error);
+    unsigned __int64 value = 0;
+    CHECK_THROWS(empty.read_varint(value), std::runtime_error);
+}
+
+TEST(typed_fields_round_trip) {
+    using body = fields<std::string, bool, unsigned int, int, unsigned __int64, __int64>;
+
+    for (unsigned char version : { wire_v2, wire_v3, wire_v4 }) {
+        frame_buffer frame(version);
+        body::encode(frame, std::string("group"), true, 4000000000u, -70000, 1ull << 63, std::numeric_limits<__int64>::min());
+
+        frame_reader reader(frame.data(), frame.size(), version);
+        auto [text, flag, unsigned_value, signed_value, big, smallest] = body::decode(reader);
+        CHECK_EQ(text, std::string("group"));
+        CHECK(flag);
+        CHECK_EQ(unsigned_value, 4000000000u);
+        CHECK_EQ(signed_value, -70000);
+        CHECK_EQ(big, 1ull << 63);
+        CHECK_EQ(smallest, std::numeric_limits<__int64>::min());
+        CHECK(reader.empty());
+    }
+}
+
+TEST(bounded_fields_fit_their_size) {
+    using body = fields<bool, unsigned __int64, __int64>;
+    static_assert(body::bounded, "all fixed size");
+    static_assert(body::max_size == 21, "a byte and two varints");
+    static_assert(!fields<std::string_view, bool>::bounded, "strings are unbounded");
+
+    frame_buffer frame(wire_v2);
+    body::encode(frame, false, std::numeric_limits<unsigned __int64>::max(), std::numeric_limits<__int64>::min());
+    CHECK_EQ(frame.size(), body::max_size);
+}
+
+TEST(truncated_body_throws) {
+    using body = fields<std::string, unsigned int>;
+    frame_buffer frame(wire_v2);
+    body::encode(frame, std::string("abc"), 300u);
+
+    for (size_t size = 0; size < frame.size(); ++size) {
+        frame_reader reader(frame.data(), size, wire_v2);
+        CHECK_THROWS(body::decode(reader), std::runtime_error);
+    }
+}
+
+TEST(frames_own_their_buffer_until_destroyed) {
+    frame_buffer frame(wire_v2);
+    frame << std::string_view("payload");
+    const char* storage = frame.data();
+
+    zframe_t* sent = frame.to_frame();
+    CHECK(frame.data() == nullptr);
+    CHECK_EQ(frame.size(), static_cast<size_t>(0));
+    CHECK(reinterpret_cast<const char*>(zframe_data(sent)) == storage); // handed over, not copied
+    CHECK_EQ(zframe_size(sent), static_cast<size_t>(8));
+
+    const frame_buffer::stats before = frame_buffer::pool_stats();
+    zframe_destroy(&sent);
+    const frame_buffer::stats released = frame_buffer::pool_stats();
+    CHECK_EQ(released.pooled, before.pooled + 1);
+
+    // and the next write picks it back up
+    frame_buffer next(wire_v2);
+    next << std::string_view("again");
+    const frame_buffer::stats reused = frame_buffer::pool_stats();
+    CHECK_EQ(reused.reused, released.reused + 1);
+    CHECK(next.data() == storage);
+}
+
+TEST(empty_frames_take_nothing_from_the_pool) {
+    const frame_buffer::stats before = frame_buffer::pool_stats();
+    frame_buffer frame(wire_v2);
+    zframe_t* sent = frame.to_frame();
+    CHECK_EQ(zframe_size(sent), static_cast<size_t>(0));
+    zframe_destroy(&sent);
+    CHECK_EQ(frame_buffer::pool_stats().acquired, before.acquired);
+}
+
+static pipe_command command_of(zmsg_t* msg) {
+    zframe_t* frame = zmsg_pop(msg);
+    const pipe_command command = pipe_command_from(frame);
+    zframe_destroy(&frame);
+    zmsg_destroy(&msg);
+    return command;
+}
+
+TEST(pipe_commands_are_one_byte) {
+    const pipe_command commands[] = { pipe_command::Term, pipe_command::Join, pipe_command::Leave, pipe_command::Shout, pipe_command::Whisper,
+        pipe_command::Evasive, pipe_command::Expired, pipe_command::Keepalive, pipe_command::Ping, pipe_command::Pong };
+
+    for (auto command : commands) {
+        zmsg_t* msg = zmsg_new();
+        zmsg_addstr(msg, "group");
+        push_pipe_command(msg, command);
+        CHECK_EQ(zframe_size(zmsg_first(msg)), static_cast<size_t>(1));
+        CHECK(command_of(msg) == command);
+    }
+}
+
+TEST(pipe_commands_fall_back_to_names) {
+    const std::pair<const char*, pipe_command> names[] = { { "$TERM", pipe_command::Term }, { "JOIN", pipe_command::Join },
+        { "LEAVE", pipe_command::Leave }, { "SHOUT", pipe_command::Shout }, { "WHISPER", pipe_command::Whisper },
+        { "EVASIVE", pipe_command::Evasive }, { "EXPIRED", pipe_command::Expired }, { "KEEPALIVE", pipe_command::Keepalive },
+        { "PING", pipe_command::Ping }, { "PONG", pipe_command::Pong } };
+
+    for (auto& name : names) {
+        zmsg_t* msg = zmsg_new();
+        zmsg_addstr(msg, name.first);
+        CHECK(command_of(msg) == name.second);
+    }
+
+    zmsg_t* lower = zmsg_new();
+    zmsg_addstr(lower, "join");
+    CHECK(command_of(lower) == pipe_command::Unknown);
+
+    zmsg_t* empty = zmsg_new();
+    zmsg_addstr(empty, "");
+    CHECK(command_of(empty) == pipe_command::Unknown);
+
+    CHECK(pipe_command_from(nullptr) == pipe_command::Unknown);
+}